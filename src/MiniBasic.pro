@@ -8,22 +8,18 @@ CONFIG += c++17
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(qbasic-core.pri)
+
 SOURCES += \
-    lexer.cpp \
+    codemodel.cpp \
     main.cpp \
     mainwindow.cpp \
-    parser.cpp \
-    statement.cpp \
-    syntax.cpp \
+    treemodel.cpp \
 
 HEADERS += \
-    lexer.h \
+    codemodel.h \
     mainwindow.h \
-    parser.h \
-    statement.h \
-    syntax.h \
-    stringutils.h \
-    table.h
+    treemodel.h \
 
 FORMS += \
     mainwindow.ui
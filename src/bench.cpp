@@ -0,0 +1,345 @@
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <thread>
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "statement.h"
+#include "table.h"
+
+namespace bench {
+    using Clock = std::chrono::steady_clock;
+
+    static double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    static std::string generateExp(std::mt19937 &rng, int depth) {
+        static const char *ops[] = {" + ", " - ", " * ", " / ", " ** "};
+        if (depth == 0 || rng() % 3 == 0) {
+            if (rng() % 2)
+                return std::string(1, char('a' + rng() % 26));
+            return std::to_string(rng() % 1000);
+        }
+        std::string exp = generateExp(rng, depth - 1) + ops[rng() % 5] + generateExp(rng, depth - 1);
+        return rng() % 4 == 0 ? "(" + exp + ")" : exp;
+    }
+
+    std::vector <std::string> generateProgram(int lines, unsigned seed) {
+        static const char *cmps[] = {" = ", " <> ", " < ", " <= ", " > ", " >= "};
+        std::mt19937 rng(seed);
+        std::vector <std::string> program;
+        program.reserve(lines);
+        for (int i = 1; i <= lines; ++i) {
+            std::string var(1, char('a' + rng() % 26));
+            std::string target = std::to_string(1 + rng() % lines);
+            std::string srcCode;
+            switch (rng() % 8) {
+                case 0:
+                    srcCode = "REM generated line " + std::to_string(i);
+                    break;
+                case 1:
+                    srcCode = "PRINT " + generateExp(rng, 3);
+                    break;
+                case 2:
+                    srcCode = "GOTO " + target;
+                    break;
+                case 3:
+                case 4:
+                    srcCode = "IF " + generateExp(rng, 2) + cmps[rng() % 6] + generateExp(rng, 2) + " THEN " + target;
+                    break;
+                default:
+                    srcCode = "LET " + var + " = " + generateExp(rng, 4);
+                    break;
+            }
+            program.push_back(srcCode);
+        }
+        return program;
+    }
+
+    void benchParse(int lines, std::ostream &os) {
+        auto program = generateProgram(lines);
+        size_t bytes = 0;
+        for (const auto &srcCode: program)
+            bytes += srcCode.size() + 1;
+
+        lexer::Lexer lexer;
+        parser::Parser parser;
+        std::vector <parser::Token> tokens;
+        size_t tokenCnt = 0;
+
+        auto start = Clock::now();
+        for (int i = 0; i < lines; ++i) {
+            lexer.scan(program[i], tokens);
+            tokenCnt += tokens.size();
+        }
+        double lexSeconds = secondsSince(start);
+
+        syntax::Arena arena;
+        std::vector<statement::Statement *> statements;
+        statements.reserve(lines);
+        start = Clock::now();
+        for (int i = 0; i < lines; ++i) {
+            lexer.scan(program[i], tokens);
+            statements.push_back(parser.parse(&arena, i + 1, program[i], tokens));
+        }
+        double totalSeconds = secondsSince(start);
+
+        start = Clock::now();
+        for (auto stmt: statements)
+            delete stmt;
+        arena.clear();
+        double teardownSeconds = secondsSince(start);
+
+        os << "lines:  " << lines << ", tokens: " << tokenCnt << ", bytes: " << bytes << '\n';
+        os << "lex:    " << lexSeconds << " s, " << lines / lexSeconds << " lines/s, "
+           << bytes / lexSeconds / 1e6 << " MB/s\n";
+        os << "parse:  " << totalSeconds - lexSeconds << " s, " << tokenCnt / (totalSeconds - lexSeconds)
+           << " tokens/s\n";
+        os << "total:  " << totalSeconds << " s, " << lines / totalSeconds << " lines/s\n";
+        os << "free:   " << teardownSeconds << " s" << std::endl;
+    }
+
+    // Keep the last output only, the program is checked by its result.
+    class SilentConsole : public interpreter::Console {
+    public:
+        std::string lastOutput;
+
+        void print(const std::string &str) override { lastOutput = str; }
+
+
+        bool input(const std::string &var) override {
+            (void) var;
+            return true;
+        }
+
+        void error(const std::string &errorMsg) override { lastOutput = errorMsg; }
+
+        void parseError(int index, int lineno, const std::string &errorMsg) override {
+            (void) index;
+            (void) lineno;
+            lastOutput = errorMsg;
+        }
+
+        void runtimeError(int index, int lineno, const std::string &errorMsg) override {
+            (void) index;
+            (void) lineno;
+            lastOutput = errorMsg;
+        }
+    };
+
+    static double timeParse(interpreter::Interpreter &interpreter) {
+        auto start = Clock::now();
+        interpreter.init();
+        interpreter.parse();
+        return secondsSince(start);
+    }
+
+    void benchReparse(int lines, std::ostream &os) {
+        auto program = generateProgram(lines);
+        SilentConsole console;
+        interpreter::Interpreter interpreter(&console);
+        // The global optimizer works on the whole program every time, it would hide the front-end.
+        interpreter.setOptimize(false);
+        for (int i = 0; i < lines; ++i)
+            interpreter.addRawStatement(statement::RawStatement(i + 1, program[i]));
+
+        double coldSeconds = timeParse(interpreter);
+        double sameSeconds = timeParse(interpreter);
+        interpreter.addRawStatement(statement::RawStatement(lines / 2, "LET a = a + 1"));
+        double editSeconds = timeParse(interpreter);
+
+        os << "lines:           " << lines << '\n';
+        os << "first parse:     " << coldSeconds << " s\n";
+        os << "unchanged:       " << sameSeconds << " s\n";
+        os << "one line edited: " << editSeconds << " s" << std::endl;
+    }
+
+    void benchFrontend(int lines, std::ostream &os) {
+        auto program = generateProgram(lines);
+        int cores = std::max(1, int(std::thread::hardware_concurrency()));
+        os << "lines: " << lines << ", cores: " << cores << '\n';
+        for (int threads = 1; threads <= std::max(cores, 8); threads *= 2) {
+            SilentConsole console;
+            interpreter::Interpreter interpreter(&console);
+            interpreter.setOptimize(false);
+            interpreter.setThreads(threads);
+            for (int i = 0; i < lines; ++i)
+                interpreter.addRawStatement(statement::RawStatement(i + 1, program[i]));
+
+            // Cached, only what follows parsing is left, and that runs on one thread.
+            double coldSeconds = timeParse(interpreter);
+            double cachedSeconds = timeParse(interpreter);
+            os << "threads: " << threads << ", parse: " << coldSeconds << " s, of which after parsing: "
+               << cachedSeconds << " s" << std::endl;
+        }
+    }
+
+    void benchLoad(int lines, std::ostream &os) {
+        auto program = generateProgram(lines);
+        std::vector<int> order(lines);
+        for (int i = 0; i < lines; ++i)
+            order[i] = i;
+        std::mt19937 rng(2021);
+        std::shuffle(order.begin(), order.end(), rng);
+        std::string text;
+        for (int i: order)
+            text += std::to_string(i + 1) + ' ' + program[i] + '\n';
+
+        // Loaded from a file as the front-ends do.
+        std::string path = (std::filesystem::temp_directory_path() / "qbasic-bench-load.txt").string();
+        std::ofstream(path, std::ios::binary) << text;
+        SilentConsole console;
+        interpreter::Interpreter interpreter(&console);
+        auto start = Clock::now();
+        bool loaded = interpreter.loadFile(path);
+        double loadSeconds = secondsSince(start);
+        std::remove(path.c_str());
+        if (!loaded) {
+            os << "can't write " << path << std::endl;
+            return;
+        }
+
+        // Replace, delete and insert back lines all over the program.
+        const int edits = 10000;
+        start = Clock::now();
+        for (int i = 0; i < edits; ++i) {
+            int lineno = 1 + rng() % lines;
+            interpreter.addRawStatement(statement::RawStatement(lineno, "PRINT " + std::to_string(i)));
+            interpreter.deleteLine(lineno);
+            interpreter.addRawStatement(statement::RawStatement(lineno, program[lineno - 1]));
+        }
+        double editSeconds = secondsSince(start);
+
+        os << "lines: " << lines << ", bytes: " << text.size() << ", shuffled\n";
+        os << "load:  " << loadSeconds << " s, " << lines / loadSeconds << " lines/s\n";
+        os << "edit:  " << editSeconds / (3.0 * edits) * 1e6 << " us per insert, replace or delete" << std::endl;
+    }
+
+    static double timeRun(const std::string &program, interpreter::Interpreter::RunMode mode, std::string &result) {
+        SilentConsole console;
+        interpreter::Interpreter interpreter(&console);
+        interpreter.setRunMode(mode);
+        interpreter.loadText(program);
+        interpreter.init();
+        interpreter.parse();
+
+        auto start = Clock::now();
+        interpreter.run();
+        double seconds = secondsSince(start);
+        result = console.lastOutput;
+        return seconds;
+    }
+
+    void benchRun(int iterations, std::ostream &os) {
+        static const std::pair<const char *, interpreter::Interpreter::RunMode> modes[] = {
+                {"tree",     interpreter::Interpreter::TREE},
+                {"bytecode", interpreter::Interpreter::BYTECODE},
+                {"jit",      interpreter::Interpreter::JIT},
+        };
+
+        // 3 statements per iteration, 4 more around the loop.
+        std::string counting =
+                "10 LET i = 0\n"
+                "20 LET s = 0\n"
+                "30 LET s = s + i * 2 - i / 3\n"
+                "40 LET i = i + 1\n"
+                "50 IF i < " + std::to_string(iterations) + " THEN 30\n"
+                "60 PRINT s\n"
+                "70 END\n";
+        double statements = 3.0 * iterations + 4;
+
+        // Total steps of the Collatz sequences starting from 1 .. iterations / 100.
+        std::string collatz =
+                "10 LET n = 1\n"
+                "20 LET steps = 0\n"
+                "30 LET x = n + 0\n"
+                "40 IF x = 1 THEN 110\n"
+                "50 LET t = x - (x / 2) * 2\n"
+                "60 IF t <> 0 THEN 90\n"
+                "70 LET x = x / 2\n"
+                "80 GOTO 100\n"
+                "90 LET x = 3 * x + 1\n"
+                "100 LET steps = steps + 1\n"
+                "105 GOTO 40\n"
+                "110 LET n = n + 1\n"
+                "120 IF n <= " + std::to_string(std::max(1, iterations / 100)) + " THEN 30\n"
+                "130 PRINT steps\n"
+                "140 END\n";
+
+        for (const auto &mode: modes) {
+            std::string result;
+            double seconds = timeRun(counting, mode.second, result);
+            os << "counting " << mode.first << ": " << seconds << " s, " << statements / seconds
+               << " statements/s, result " << result << '\n';
+        }
+        for (const auto &mode: modes) {
+            std::string result;
+            double seconds = timeRun(collatz, mode.second, result);
+            os << "collatz  " << mode.first << ": " << seconds << " s, result " << result << '\n';
+        }
+        os.flush();
+    }
+
+    // The former std::map based env::Table, as the baseline.
+    template<typename K, typename V>
+    class MapTable {
+    private:
+        std::map <K, V> map;
+    public:
+        inline V *look(const K &key) {
+            if (map.find(key) != map.end())
+                return &(map[key]);
+            return nullptr;
+        }
+
+        inline void enter(const K &key, const V &value) {
+            map[key] = value;
+        }
+    };
+
+    template<typename T>
+    static void timeTable(const char *name, const std::vector <std::string> &symbols,
+                          const std::vector<int> &order, std::ostream &os) {
+        T table;
+        auto start = Clock::now();
+        int len = symbols.size();
+        for (int i = 0; i < len; ++i)
+            table.enter(symbols[i], i);
+        double enterSeconds = secondsSince(start);
+
+        long long sum = 0;
+        start = Clock::now();
+        for (int idx: order)
+            sum += *table.look(symbols[idx]);
+        double lookSeconds = secondsSince(start);
+
+        os << "  " << name << ": enter " << enterSeconds * 1e9 / len << " ns/var, look "
+           << lookSeconds * 1e9 / order.size() << " ns/lookup, checksum " << sum << '\n';
+    }
+
+    void benchTable(int lookups, std::ostream &os) {
+        static const int sizes[] = {10, 1000, 100000};
+        std::mt19937 rng(2021);
+        for (int size: sizes) {
+            std::vector <std::string> symbols;
+            symbols.reserve(size);
+            for (int i = 0; i < size; ++i)
+                symbols.push_back("var" + std::to_string(rng()));
+            std::vector<int> order(lookups);
+            for (auto &idx: order)
+                idx = rng() % size;
+
+            os << size << " variables, " << lookups << " lookups:\n";
+            timeTable<MapTable<std::string, int>>("std::map  ", symbols, order, os);
+            timeTable<env::Table<std::string, int>>("env::Table", symbols, order, os);
+        }
+        os.flush();
+    }
+}
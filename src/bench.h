@@ -0,0 +1,31 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace bench {
+    // Generate a random but valid program of the given number of lines, same seed gives the same program.
+    std::vector <std::string> generateProgram(int lines, unsigned seed = 2021);
+
+    // Lex and parse a generated program and report the throughput.
+    void benchParse(int lines, std::ostream &os);
+
+    // Parse a generated program unoptimized on 1, 2, 4, ... threads, up to the number of cores or at least 8.
+    void benchFrontend(int lines, std::ostream &os);
+
+    // Load a generated program from text with its lines shuffled, then edit lines all over it.
+    void benchLoad(int lines, std::ostream &os);
+
+    // Parse a generated program unoptimized, then again unchanged and after a one-line edit, from the cache.
+    void benchReparse(int lines, std::ostream &os);
+
+    // Run a counting loop and a Collatz program in every run mode and report the speed.
+    void benchRun(int iterations, std::ostream &os);
+
+    // Enter 10, 1k and 100k variables into env::Table and std::map, then compare the lookups.
+    void benchTable(int lookups, std::ostream &os);
+}
+
+#endif // BENCH_H
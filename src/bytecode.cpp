@@ -0,0 +1,362 @@
+#include "bytecode.h"
+#include <algorithm>
+#include <cmath>
+#include "interpreter.h"
+#include "statement.h"
+
+namespace bytecode {
+    int Program::stmtIndexOf(int pc) const {
+        auto it = std::upper_bound(stmtStart.begin(), stmtStart.end(), pc);
+        return int(it - stmtStart.begin()) - 1;
+    }
+
+    std::unique_ptr <Program> Compiler::compile(const std::vector<statement::Statement *> &statements) {
+        program = std::make_unique<Program>();
+        jumps.clear();
+        depth = 0;
+
+        int len = statements.size();
+        for (int i = 0; i < len; ++i) {
+            program->stmtStart.push_back(program->code.size());
+            if (statements[i])
+                statements[i]->compile(this);
+        }
+        program->stmtStart.push_back(program->code.size());
+        append(HALT);
+
+        for (int pc: jumps) {
+            Instr &instr = program->code[pc];
+            instr.arg = program->stmtStart[instr.arg];
+        }
+
+        return std::move(program);
+    }
+
+    void Compiler::append(OpCode op, int arg, int arg2, int arg3) {
+        program->code.push_back(Instr{op, arg, arg2, arg3});
+        switch (op) {
+            case LOAD:
+            case LOAD_INT:
+                program->slotCount = std::max(program->slotCount, arg + 1);
+                program->maxStack = std::max(program->maxStack, ++depth);
+                break;
+            case PUSH_INT:
+            case PUSH_STR:
+                program->maxStack = std::max(program->maxStack, ++depth);
+                break;
+            case STORE:
+                program->slotCount = std::max(program->slotCount, arg + 1);
+                --depth;
+                break;
+            case INPUT:
+            case INC:
+                program->slotCount = std::max(program->slotCount, arg + 1);
+                break;
+            case STORE_JUMP:
+                program->slotCount = std::max(program->slotCount, arg2 + 1);
+                --depth;
+                break;
+            case INC_JUMP:
+            case BRANCH_EQ:
+            case BRANCH_NEQ:
+            case BRANCH_GT:
+            case BRANCH_GE:
+            case BRANCH_LT:
+            case BRANCH_LE:
+                program->slotCount = std::max(program->slotCount, arg2 + 1);
+                break;
+            case JUMP:
+            case HALT:
+                break;
+            default:
+                --depth;
+                break;
+        }
+    }
+
+    void Compiler::appendJump(OpCode op, int index, int arg2, int arg3) {
+        if (index < 0) {
+            append(op, -1, arg2, arg3);
+            return;
+        }
+        jumps.push_back(program->code.size());
+        append(op, index, arg2, arg3);
+    }
+
+    int Compiler::constString(const std::string &str) {
+        program->strings.push_back(str);
+        return program->strings.size() - 1;
+    }
+
+    Machine::Machine(const Program *program)
+            : program(program),
+              variables(program->slotCount, Value{UNDEFINED, 0, nullptr}),
+              slotStrings(program->slotCount),
+              stack(program->maxStack + 1) {}
+
+    void Machine::loadSlot(interpreter::Interpreter *interpreter, int slot) {
+        const env::Variable &variable = interpreter->variables[slot];
+        if (!variable.defined) {
+            variables[slot] = Value{UNDEFINED, 0, nullptr};
+        } else if (variable.type == env::INT) {
+            variables[slot] = Value{INT, variable.value.getInt(), nullptr};
+        } else {
+            slotStrings[slot] = variable.value.getString();
+            variables[slot] = Value{STRING, 0, &slotStrings[slot]};
+        }
+    }
+
+    void Machine::storeSlots(interpreter::Interpreter *interpreter) const {
+        int len = variables.size();
+        for (int i = 0; i < len; ++i) {
+            if (variables[i].type == INT)
+                interpreter->variables[i].set(variables[i].iVal);
+            else if (variables[i].type == STRING)
+                interpreter->variables[i].set(*variables[i].sVal);
+        }
+    }
+
+    void Machine::reload(interpreter::Interpreter *interpreter, int slot) {
+        // A slot the program doesn't use, e.g. INPUT in command line.
+        if (slot < int(variables.size()))
+            loadSlot(interpreter, slot);
+    }
+
+    void Machine::run(interpreter::Interpreter *interpreter, long long budget) {
+        if (finished) return;
+        fuel = budget;
+
+        if (!loaded) {
+            int len = variables.size();
+            for (int i = 0; i < len; ++i)
+                loadSlot(interpreter, i);
+            loaded = true;
+        }
+
+        while (!execute(interpreter));
+
+        storeSlots(interpreter);
+    }
+
+    bool Machine::execute(interpreter::Interpreter *interpreter) {
+        const Instr *code = program->code.data();
+        const Instr *ip = code + pc;
+        Value *sp = stack.data();
+
+        try {
+            for (;;) {
+                const Instr &instr = *ip++;
+                switch (instr.op) {
+                    case PUSH_INT:
+                        *sp++ = Value{INT, instr.arg, nullptr};
+                        break;
+                    case PUSH_STR:
+                        *sp++ = Value{STRING, 0, &program->strings[instr.arg]};
+                        break;
+                    case LOAD: {
+                        const Value &value = variables[instr.arg];
+                        if (value.type == UNDEFINED)
+                            throw "Use undefined variable!";
+                        *sp++ = value;
+                        break;
+                    }
+                    case LOAD_INT:
+                        *sp++ = variables[instr.arg];
+                        break;
+                    case STORE: {
+                        const Value &value = *--sp;
+                        if (value.type == STRING) {
+                            slotStrings[instr.arg] = *value.sVal;
+                            variables[instr.arg] = Value{STRING, 0, &slotStrings[instr.arg]};
+                        } else {
+                            variables[instr.arg] = value;
+                        }
+                        break;
+                    }
+                    case ADD:
+                    case SUB:
+                    case MUL:
+                    case DIV:
+                    case POW: {
+                        int right = (--sp)->iVal;
+                        Value &left = sp[-1];
+                        if (left.type != INT || sp->type != INT)
+                            throw "Arithmetic operation only supports int!";
+                        switch (instr.op) {
+                            case ADD:
+                                left.iVal += right;
+                                break;
+                            case SUB:
+                                left.iVal -= right;
+                                break;
+                            case MUL:
+                                left.iVal *= right;
+                                break;
+                            case DIV:
+                                if (right == 0) throw "Divided by zero!";
+                                left.iVal /= right;
+                                break;
+                            default:
+                                // 0 ** 0, 0 ** -1 is no valid, but 0 ** 1 is valid.
+                                if (left.iVal == 0 && right <= 0)
+                                    throw "Invalid index operation!";
+                                left.iVal = int(pow(left.iVal, right));
+                                break;
+                        }
+                        break;
+                    }
+                    case CMP_EQ:
+                    case CMP_NEQ:
+                    case CMP_GT:
+                    case CMP_GE:
+                    case CMP_LT:
+                    case CMP_LE: {
+                        int right = (--sp)->iVal;
+                        Value &left = sp[-1];
+                        if (left.type != INT || sp->type != INT)
+                            throw "Logical operation only supports int!";
+                        switch (instr.op) {
+                            case CMP_EQ:
+                                left.iVal = left.iVal == right;
+                                break;
+                            case CMP_NEQ:
+                                left.iVal = left.iVal != right;
+                                break;
+                            case CMP_GT:
+                                left.iVal = left.iVal > right;
+                                break;
+                            case CMP_GE:
+                                left.iVal = left.iVal >= right;
+                                break;
+                            case CMP_LT:
+                                left.iVal = left.iVal < right;
+                                break;
+                            default:
+                                left.iVal = left.iVal <= right;
+                                break;
+                        }
+                        break;
+                    }
+                    case JUMP:
+                        if (instr.arg < 0) throw "Use non-existent line number!";
+                        ip = code + instr.arg;
+                        if (--fuel == 0) goto pause;
+                        break;
+                    case JUMP_IF:
+                        if ((--sp)->iVal == 1) {
+                            if (instr.arg < 0) throw "Use non-existent line number!";
+                            ip = code + instr.arg;
+                            if (--fuel == 0) goto pause;
+                        }
+                        break;
+                    case PRINT: {
+                        const Value &value = *--sp;
+                        if (value.type == INT)
+                            interpreter->print(std::to_string(value.iVal));
+                        else
+                            interpreter->print(*value.sVal);
+                        break;
+                    }
+                    case INPUT:
+                        pc = ip - code;
+                        interpreter->input(interpreter->symbols[instr.arg]);
+                        if (interpreter->isFinished()) {
+                            // Ended by the console, e.g. no more input.
+                            finished = true;
+                            return true;
+                        }
+                        // The value taken is reloaded by the interpreter, a bad one leaves the slot as it was.
+                        if (interpreter->isSuspended())
+                            return true;
+                        break;
+                    case HALT:
+                        pc = ip - 1 - code;
+                        finished = true;
+                        return true;
+                    case INC:
+                    case INC_JUMP: {
+                        int slot = instr.op == INC ? instr.arg : instr.arg2;
+                        Value &value = variables[slot];
+                        if (value.type == UNDEFINED)
+                            throw "Use undefined variable!";
+                        if (value.type != INT)
+                            throw "Arithmetic operation only supports int!";
+                        ++interpreter->fused.increments;
+                        if (instr.op == INC) {
+                            value.iVal += instr.arg2;
+                        } else {
+                            value.iVal += instr.arg3;
+                            ++interpreter->fused.gotos;
+                            ip = code + instr.arg;
+                            if (--fuel == 0) goto pause;
+                        }
+                        break;
+                    }
+                    case STORE_JUMP: {
+                        const Value &value = *--sp;
+                        if (value.type == STRING) {
+                            slotStrings[instr.arg2] = *value.sVal;
+                            variables[instr.arg2] = Value{STRING, 0, &slotStrings[instr.arg2]};
+                        } else {
+                            variables[instr.arg2] = value;
+                        }
+                        ++interpreter->fused.gotos;
+                        ip = code + instr.arg;
+                        if (--fuel == 0) goto pause;
+                        break;
+                    }
+                    case BRANCH_EQ:
+                    case BRANCH_NEQ:
+                    case BRANCH_GT:
+                    case BRANCH_GE:
+                    case BRANCH_LT:
+                    case BRANCH_LE: {
+                        const Value &value = variables[instr.arg2];
+                        if (value.type == UNDEFINED)
+                            throw "Use undefined variable!";
+                        if (value.type != INT)
+                            throw "Logical operation only supports int!";
+                        ++interpreter->fused.branches;
+                        bool taken;
+                        switch (instr.op) {
+                            case BRANCH_EQ:
+                                taken = value.iVal == instr.arg3;
+                                break;
+                            case BRANCH_NEQ:
+                                taken = value.iVal != instr.arg3;
+                                break;
+                            case BRANCH_GT:
+                                taken = value.iVal > instr.arg3;
+                                break;
+                            case BRANCH_GE:
+                                taken = value.iVal >= instr.arg3;
+                                break;
+                            case BRANCH_LT:
+                                taken = value.iVal < instr.arg3;
+                                break;
+                            default:
+                                taken = value.iVal <= instr.arg3;
+                                break;
+                        }
+                        if (taken) {
+                            if (instr.arg < 0) throw "Use non-existent line number!";
+                            ip = code + instr.arg;
+                            if (--fuel == 0) goto pause;
+                        }
+                        break;
+                    }
+                }
+            }
+            // Out of fuel, a jump goes to the start of a statement, so it is resumed from there.
+            pause:
+            pc = ip - code;
+            return true;
+        } catch (const char *errorMsg) {
+            // Report, then go on with the next statement, same as the tree walker.
+            int idx = program->stmtIndexOf(ip - 1 - code);
+            interpreter->runtimeError(idx, errorMsg);
+            pc = program->stmtStart[idx + 1];
+            return false;
+        }
+    }
+}
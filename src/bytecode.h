@@ -0,0 +1,158 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace statement {
+    class Statement;
+}
+
+namespace interpreter {
+    class Interpreter;
+}
+
+namespace bytecode {
+    enum OpCode : unsigned char {
+        PUSH_INT,       // push arg
+        PUSH_STR,       // push the arg-th string constant
+        LOAD,           // push the value of slot arg
+        STORE,          // pop into slot arg
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        POW,
+        CMP_EQ,
+        CMP_NEQ,
+        CMP_GT,
+        CMP_GE,
+        CMP_LT,
+        CMP_LE,
+        JUMP,           // goto code arg, arg < 0 means the line doesn't exist
+        JUMP_IF,        // pop, goto code arg if it's 1
+        PRINT,          // pop and print
+        INPUT,          // input slot arg, may suspend the machine
+        HALT,
+        // Fused forms of common statements.
+        INC,            // add arg2 to the int in slot arg
+        INC_JUMP,       // INC of slot arg2 by arg3, then JUMP
+        STORE_JUMP,     // pop into slot arg2, then JUMP
+        BRANCH_EQ,      // goto code arg if slot arg2 op arg3 holds, same order as syntax::LogicOp
+        BRANCH_NEQ,
+        BRANCH_GT,
+        BRANCH_GE,
+        BRANCH_LT,
+        BRANCH_LE,
+        LOAD_INT,       // LOAD of a slot proven to hold an int, unchecked
+    };
+
+    struct Instr {
+        OpCode op;
+        int arg;
+        int arg2;
+        int arg3;
+    };
+
+    enum ValueType : unsigned char {
+        UNDEFINED,
+        INT,
+        STRING
+    };
+
+    struct Value {
+        ValueType type;
+        int iVal;
+        const std::string *sVal;
+    };
+
+    class Program {
+    public:
+        std::vector <Instr> code;
+
+        // Code of the i-th statement is [stmtStart[i], stmtStart[i + 1]), invalid statements have no code.
+        std::vector<int> stmtStart;
+
+        // Number of variable slots used, same slots as the interpreter's.
+        int slotCount = 0;
+
+        std::vector <std::string> strings;
+
+        int maxStack = 0;
+
+        // Index of the statement the code at pc belongs to.
+        int stmtIndexOf(int pc) const;
+    };
+
+    class Compiler {
+    public:
+        Compiler() = default;
+
+        std::unique_ptr <Program> compile(const std::vector<statement::Statement *> &statements);
+
+        void append(OpCode op, int arg = 0, int arg2 = 0, int arg3 = 0);
+
+        // Jump to the index-th statement, patched to its code once all the statements are compiled.
+        void appendJump(OpCode op, int index, int arg2 = 0, int arg3 = 0);
+
+        int constString(const std::string &str);
+
+    private:
+        std::unique_ptr <Program> program;
+
+        // Code indices whose arg is a statement index to patch.
+        std::vector<int> jumps;
+
+        int depth = 0;
+    };
+
+    class Machine {
+    public:
+        Machine(const Program *program);
+
+        // Run from the current pc, until HALT or an INPUT suspends it, or until budget jumps have been taken.
+        void run(interpreter::Interpreter *interpreter, long long budget);
+
+        inline bool isFinished() const {
+            return finished;
+        }
+
+        inline int stmtIndex() const {
+            return program->stmtIndexOf(pc);
+        }
+
+        // The interpreter's variable in the slot has been changed outside, e.g. by INPUT.
+        void reload(interpreter::Interpreter *interpreter, int slot);
+
+    private:
+        const Program *program;
+
+        std::vector <Value> variables;
+
+        // Strings held by the variables.
+        std::vector <std::string> slotStrings;
+
+        std::vector <Value> stack;
+
+        int pc = 0;
+
+        bool finished = false;
+
+        // The variables are loaded from the interpreter's once, then only the ones changed outside.
+        bool loaded = false;
+
+        // Jumps left to take in this run, it stops at the target of the last one.
+        long long fuel = 0;
+
+        // Exchange the variables with the interpreter's, in case of INPUT and PRINT in command line.
+        void loadSlot(interpreter::Interpreter *interpreter, int slot);
+
+        void storeSlots(interpreter::Interpreter *interpreter) const;
+
+        // Return true if stopped, or false if a runtime error interrupts the current statement.
+        bool execute(interpreter::Interpreter *interpreter);
+    };
+}
+
+#endif // BYTECODE_H
@@ -0,0 +1,94 @@
+#include "check.h"
+#include <fstream>
+#include "interpreter.h"
+#include "stringutils.h"
+
+namespace check {
+    // Record the output of a run, and stop the endless ones after enough of it.
+    class CaptureConsole : public interpreter::Console {
+    public:
+        CaptureConsole(const std::vector <std::string> &lines) : lines(lines) {}
+
+        interpreter::Interpreter *interpreter = nullptr;
+
+        std::vector <std::string> output;
+
+        void print(const std::string &str) override { add(str); }
+
+
+        bool input(const std::string &var) override {
+            if (next >= lines.size()) {
+                interpreter->end();
+                return true;
+            }
+            interpreter->setInput(var, StringUtils::trim(lines[next++]));
+            return true;
+        }
+
+        void error(const std::string &errorMsg) override { add("Error: " + errorMsg); }
+
+        void parseError(int index, int lineno, const std::string &errorMsg) override {
+            (void) index;
+            add("Line " + std::to_string(lineno) + ": " + errorMsg);
+        }
+
+        void runtimeError(int index, int lineno, const std::string &errorMsg) override {
+            (void) index;
+            add("Line " + std::to_string(lineno) + ": " + errorMsg);
+        }
+
+    private:
+        static const size_t MAX_OUTPUT = 10000;
+
+        const std::vector <std::string> &lines;
+
+        size_t next = 0;
+
+        void add(const std::string &line) {
+            output.push_back(line);
+            if (output.size() >= MAX_OUTPUT)
+                interpreter->end();
+        }
+    };
+
+    static std::vector <std::string> runFile(const std::string &file, interpreter::Interpreter::RunMode mode,
+                                             const std::vector <std::string> &input) {
+        CaptureConsole console(input);
+        interpreter::Interpreter interpreter(&console);
+        console.interpreter = &interpreter;
+        interpreter.setRunMode(mode);
+
+        interpreter.loadFile(file);
+        interpreter.init();
+        interpreter.parse();
+        interpreter.run();
+        return console.output;
+    }
+
+    int compareJit(const std::vector <std::string> &files, const std::vector <std::string> &input, std::ostream &os) {
+        int failed = 0;
+        for (const auto &file: files) {
+            if (!std::ifstream(file)) {
+                os << "FAIL " << file << ": can't open it\n";
+                ++failed;
+                continue;
+            }
+            auto expected = runFile(file, interpreter::Interpreter::TREE, input);
+            auto actual = runFile(file, interpreter::Interpreter::JIT, input);
+            if (expected == actual) {
+                os << "ok   " << file << ": " << expected.size() << " lines\n";
+                continue;
+            }
+
+            size_t line = 0;
+            while (line < expected.size() && line < actual.size() && expected[line] == actual[line])
+                ++line;
+            os << "FAIL " << file << ": line " << line + 1 << ", tree: "
+               << (line < expected.size() ? expected[line] : "<end>") << ", jit: "
+               << (line < actual.size() ? actual[line] : "<end>") << '\n';
+            ++failed;
+        }
+        os.flush();
+        return failed;
+    }
+}
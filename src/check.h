@@ -0,0 +1,14 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace check {
+    // Run each program on the tree walker and on the JIT, feeding both the same input lines, and compare
+    // their output, errors included. Return the number of programs whose output differs.
+    int compareJit(const std::vector <std::string> &files, const std::vector <std::string> &input, std::ostream &os);
+}
+
+#endif // CHECK_H
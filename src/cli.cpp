@@ -0,0 +1,211 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "interpreter.h"
+#include "stringutils.h"
+#include "bench.h"
+#include "check.h"
+#include "optimizer.h"
+
+// Headless front-end: run a program from a file or stdin, PRINT to stdout.
+class CliConsole : public interpreter::Console {
+public:
+    interpreter::Interpreter *interpreter = nullptr;
+
+    inline void print(const std::string &str) override {
+        std::cout << str << '\n';
+    }
+
+    bool input(const std::string &var) override {
+        std::string value;
+        std::cerr << "? " << std::flush;
+        if (!std::getline(std::cin, value)) {
+            // No more input, nothing left to feed the program.
+            interpreter->end();
+            return true;
+        }
+        interpreter->setInput(var, StringUtils::trim(value));
+        return true;
+    }
+
+    inline void error(const std::string &errorMsg) override {
+        std::cerr << "Error: " << errorMsg << std::endl;
+    }
+
+    inline void parseError(int index, int lineno, const std::string &errorMsg) override {
+        (void) index;
+        std::cerr << "Line " << lineno << ": " << errorMsg << std::endl;
+    }
+
+    inline void runtimeError(int index, int lineno, const std::string &errorMsg) override {
+        (void) index;
+        std::cerr << "Line " << lineno << ": " << errorMsg << std::endl;
+    }
+};
+
+static void usage(const char *prog) {
+    std::cerr << "Usage: " << prog << " [--mode tree|bytecode|jit] [--no-opt] [--report] [--emit-cpp] [file]" << std::endl;
+    std::cerr << "       " << prog << " --bench-parse [lines]" << std::endl;
+    std::cerr << "       " << prog << " --bench-frontend [lines]" << std::endl;
+    std::cerr << "       " << prog << " --bench-load [lines]" << std::endl;
+    std::cerr << "       " << prog << " --bench-reparse [lines]" << std::endl;
+    std::cerr << "       " << prog << " --bench-run [iterations]" << std::endl;
+    std::cerr << "       " << prog << " --bench-table [lookups]" << std::endl;
+    std::cerr << "Run the QBasic program in file, or read it from stdin if file is absent or \"-\"." << std::endl;
+    std::cerr << "--mode:        walk the syntax trees (default), run on the bytecode machine, or as native code."
+              << std::endl;
+    std::cerr << "--no-opt:      run the program as parsed, without optimizing it." << std::endl;
+    std::cerr << "--report:      print what the optimizer did, and how often the fused forms ran, to stderr."
+              << std::endl;
+    std::cerr << "--emit-cpp:    print the program as C++ source to build with g++, instead of running it."
+              << std::endl;
+    std::cerr << "--bench-parse: lex and parse a generated program, 100000 lines by default." << std::endl;
+    std::cerr << "--bench-frontend: parse a generated program on more and more threads, 200000 lines by default."
+              << std::endl;
+    std::cerr << "--bench-load:  load a generated program with shuffled lines, then edit it, 1000000 lines by default."
+              << std::endl;
+    std::cerr << "--bench-reparse: parse a generated program, then again after a one-line edit, 50000 lines by default."
+              << std::endl;
+    std::cerr << "--bench-run:   run a counting loop in every mode, 1000000 iterations by default." << std::endl;
+    std::cerr << "--bench-table: compare the variable table with std::map, 1000000 lookups by default." << std::endl;
+    std::cerr << "--check-jit:   run each file on the tree walker and the JIT with the input from stdin, and compare."
+              << std::endl;
+}
+
+static int benchCount(int argc, char *argv[], int defaultCount) {
+    return argc >= 3 ? std::atoi(argv[2]) : defaultCount;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2 && std::string(argv[1]) == "--bench-parse") {
+        int lines = benchCount(argc, argv, 100000);
+        if (lines <= 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        bench::benchParse(lines, std::cout);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-frontend") {
+        int lines = benchCount(argc, argv, 200000);
+        if (lines <= 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        bench::benchFrontend(lines, std::cout);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-load") {
+        int lines = benchCount(argc, argv, 1000000);
+        if (lines <= 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        bench::benchLoad(lines, std::cout);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-reparse") {
+        int lines = benchCount(argc, argv, 50000);
+        if (lines <= 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        bench::benchReparse(lines, std::cout);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-run") {
+        int iterations = benchCount(argc, argv, 1000000);
+        if (iterations <= 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        bench::benchRun(iterations, std::cout);
+        return 0;
+    }
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-table") {
+        int lookups = benchCount(argc, argv, 1000000);
+        if (lookups <= 0) {
+            usage(argv[0]);
+            return 2;
+        }
+        bench::benchTable(lookups, std::cout);
+        return 0;
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "--check-jit") {
+        std::vector <std::string> files(argv + 2, argv + argc);
+        std::vector <std::string> input;
+        std::string line;
+        while (std::getline(std::cin, line))
+            input.push_back(line);
+        return check::compareJit(files, input, std::cout) == 0 ? 0 : 1;
+    }
+
+    CliConsole console;
+    interpreter::Interpreter interpreter(&console);
+    console.interpreter = &interpreter;
+
+    std::string fileName = "-";
+    bool hasFile = false;
+    bool report = false;
+    bool emitCpp = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "tree") {
+                interpreter.setRunMode(interpreter::Interpreter::TREE);
+            } else if (mode == "bytecode") {
+                interpreter.setRunMode(interpreter::Interpreter::BYTECODE);
+            } else if (mode == "jit") {
+                interpreter.setRunMode(interpreter::Interpreter::JIT);
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (arg == "--no-opt") {
+            interpreter.setOptimize(false);
+        } else if (arg == "--report") {
+            report = true;
+        } else if (arg == "--emit-cpp") {
+            emitCpp = true;
+        } else if (!hasFile && (arg == "-" || arg[0] != '-')) {
+            fileName = arg;
+            hasFile = true;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (fileName == "-") {
+        interpreter.load(std::cin);
+        // The program consumed stdin, INPUT gets nothing.
+        std::cin.clear();
+    } else if (!interpreter.loadFile(fileName)) {
+        std::cerr << "Can't open file " << fileName << std::endl;
+        return 1;
+    }
+
+    interpreter.init();
+    interpreter.parse();
+    if (report)
+        std::cerr << interpreter.getReport().toString();
+    if (emitCpp) {
+        std::cout << interpreter.transpile();
+        return 0;
+    }
+    interpreter.run();
+    std::cout.flush();
+    if (report)
+        std::cerr << interpreter.fused.toString();
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "codemodel.h"
+#include "statement.h"
+#include "source.h"
+
+CodeModel::CodeModel(interpreter::Interpreter *interpreter, QObject *parent)
+        : QAbstractListModel(parent), interpreter(interpreter) {}
+
+int CodeModel::rowCount(const QModelIndex &parent) const {
+    if (parent.isValid())
+        return 0;
+    return int(interpreter->rawStatements->size());
+}
+
+QVariant CodeModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= rowCount())
+        return QVariant();
+    if (role == Qt::DisplayRole)
+        return QString::fromStdString(interpreter->rawStatements->at(index.row()).toString());
+    if (role == Qt::BackgroundRole) {
+        auto it = marks.find(index.row());
+        if (it != marks.end())
+            return it->second;
+    }
+    return QVariant();
+}
+
+void CodeModel::setLine(statement::RawStatement &&line) {
+    auto &listing = *interpreter->rawStatements;
+    // The marks belong to the rows before the edit.
+    clearMarks();
+    int row = int(listing.indexOf(line.lineno));
+    if (listing.find(line.lineno) != nullptr) {
+        interpreter->addRawStatement(std::move(line));
+        emit dataChanged(this->index(row), this->index(row), {Qt::DisplayRole});
+        return;
+    }
+    beginInsertRows(QModelIndex(), row, row);
+    interpreter->addRawStatement(std::move(line));
+    endInsertRows();
+}
+
+void CodeModel::deleteLine(int lineno) {
+    auto &listing = *interpreter->rawStatements;
+    if (listing.find(lineno) == nullptr)
+        throw "Use non-existent line number!";
+    clearMarks();
+    int row = int(listing.indexOf(lineno));
+    beginRemoveRows(QModelIndex(), row, row);
+    interpreter->deleteLine(lineno);
+    endRemoveRows();
+}
+
+bool CodeModel::load(const std::string &path) {
+    beginResetModel();
+    marks.clear();
+    bool loaded = interpreter->loadFile(path);
+    endResetModel();
+    return loaded;
+}
+
+void CodeModel::clear() {
+    beginResetModel();
+    marks.clear();
+    interpreter->clear();
+    endResetModel();
+}
+
+void CodeModel::mark(int row, const QColor &color) {
+    if (row < 0 || row >= rowCount())
+        return;
+    marks[row] = color;
+    emit dataChanged(index(row), index(row), {Qt::BackgroundRole});
+}
+
+void CodeModel::clearMarks() {
+    std::unordered_map<int, QColor> marked;
+    marked.swap(marks);
+    for (const auto &mark: marked)
+        emit dataChanged(index(mark.first), index(mark.first), {Qt::BackgroundRole});
+}
@@ -0,0 +1,48 @@
+#ifndef CODEMODEL_H
+#define CODEMODEL_H
+
+#include <QAbstractListModel>
+#include <QColor>
+#include <unordered_map>
+#include "interpreter.h"
+
+namespace statement {
+    class RawStatement;
+}
+
+// Lines of the program as rows of a view, which only asks for the rows it shows. A row is the index of the line
+// in line number order, so also the index of its statement. The program is edited through the model, so that
+// an edit only inserts, removes or redraws the row of the line.
+class CodeModel : public QAbstractListModel {
+    Q_OBJECT
+
+public:
+    CodeModel(interpreter::Interpreter *interpreter, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Insert the line, or replace the one with the same number.
+    void setLine(statement::RawStatement &&line);
+
+    void deleteLine(int lineno);
+
+    // Replace the program with the file, false if it can't be opened.
+    bool load(const std::string &path);
+
+    void clear();
+
+    // Set the background of the row, e.g. a statement that failed.
+    void mark(int row, const QColor &color);
+
+    void clearMarks();
+
+private:
+    interpreter::Interpreter *interpreter;
+
+    // Row -> background, only the rows marked.
+    std::unordered_map<int, QColor> marks;
+};
+
+#endif // CODEMODEL_H
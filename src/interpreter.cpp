@@ -0,0 +1,529 @@
+#include "interpreter.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <regex>
+#include "statement.h"
+#include "source.h"
+#include "lexer.h"
+#include "parser.h"
+#include "bytecode.h"
+#include "optimizer.h"
+#include "jit.h"
+#include "transpiler.h"
+
+namespace interpreter {
+    std::string FusedCounts::toString() const {
+        return "fused forms run: increments " + std::to_string(increments) + ", branches " + std::to_string(branches)
+               + ", gotos " + std::to_string(gotos) + '\n';
+    }
+
+    Interpreter::Interpreter(Console *console)
+            : symtab(std::make_unique<env::Table<std::string, int>>()),
+              rawStatements(std::make_unique<source::Listing>()),
+              console(console),
+              lexer(std::make_unique<lexer::Lexer>()), parser(std::make_unique<parser::Parser>()),
+              arena(std::make_unique<syntax::Arena>()),
+              report(std::make_unique<optimizer::Report>()) {}
+
+    Interpreter::~Interpreter() {
+        clear();
+    }
+
+    void Interpreter::addRawStatement(statement::RawStatement &&rawStmt) {
+        if (reusable) {
+            auto line = rawStatements->find(rawStmt.lineno);
+            // The same source keeps its statement.
+            if (line == nullptr)
+                record(Edit::INSERT, rawStmt.lineno);
+            else if (line->srcCode != rawStmt.srcCode)
+                record(Edit::REPLACE, rawStmt.lineno);
+        }
+        rawStatements->set(std::move(rawStmt));
+    }
+
+    void Interpreter::deleteLine(int lineno) {
+        if (rawStatements->find(lineno) == nullptr)
+            throw "Use non-existent line number!";
+        if (reusable)
+            record(Edit::ERASE, lineno);
+        rawStatements->erase(lineno);
+    }
+
+    void Interpreter::record(Edit::Kind kind, int lineno) {
+        if (edits.size() == MAX_EDITS) {
+            reusable = false;
+            edits.clear();
+            return;
+        }
+        edits.push_back(Edit{kind, int(rawStatements->indexOf(lineno)), lineno});
+    }
+
+    void Interpreter::load(std::istream &in) {
+        std::string text(std::istreambuf_iterator<char>(in), {});
+        loadText(text);
+    }
+
+    bool Interpreter::loadFile(const std::string &path) {
+        source::MappedFile file(path);
+        if (!file.isOpen())
+            return false;
+        loadText(file.text());
+        return true;
+    }
+
+    void Interpreter::loadText(std::string_view text) {
+        // Sorted and added at once, a line given twice keeps the last source as if added one by one.
+        std::vector <statement::RawStatement> lines;
+        std::string errors;
+        int errorCnt = 0;
+        int fileLineno = 0;
+        for (size_t pos = 0; pos < text.size();) {
+            auto line = source::nextLine(text, pos);
+            ++fileLineno;
+            if (line.empty()) continue;
+            try {
+                lines.push_back(statement::RawStatement::fromCmdline(line));
+            } catch (const char *errorMsg) {
+                if (++errorCnt <= MAX_LOAD_ERRORS)
+                    errors += "\nline " + std::to_string(fileLineno) + ": " + errorMsg;
+            }
+        }
+        // Too many edits to replay.
+        reusable = false;
+        edits.clear();
+        rawStatements->merge(std::move(lines));
+
+        // All at once, not one message per line.
+        if (errorCnt > MAX_LOAD_ERRORS)
+            errors += "\n... and " + std::to_string(errorCnt - MAX_LOAD_ERRORS) + " more";
+        if (errorCnt > 0)
+            console->error(std::to_string(errorCnt) + (errorCnt == 1 ? " line" : " lines") + " of the file skipped:"
+                           + errors);
+    }
+
+    void Interpreter::init() {
+        // The slots stay, the statements are resolved to them.
+        for (auto &variable: variables)
+            variable = env::Variable();
+
+        stmtIdx = 0;
+        suspended = false;
+        awaiting = -1;
+        fused = FusedCounts();
+
+        machine.reset();
+        program.reset();
+        native.reset();
+    }
+
+    void Interpreter::clear() {
+        rawStatements->clear();
+        for (auto stmt: statements) {
+            if (stmt) delete stmt;
+        }
+        statements.clear();
+        arena->clear();
+        reusable = false;
+        edits.clear();
+
+        clearVariables();
+
+        stmtIdx = 0;
+        suspended = false;
+        awaiting = -1;
+        fused = FusedCounts();
+
+        machine.reset();
+        program.reset();
+        native.reset();
+    }
+
+    void Interpreter::parse() {
+        *report = optimizer::Report();
+        // The arena is compacted by a rebuild once the updates left as many nodes behind as there are in use.
+        if (reusable && !optimize && grown * 2 <= arena->size())
+            update();
+        else
+            rebuild();
+
+        // The whole program is known only now, statements are fused last as the analyses don't know them.
+        if (optimize) {
+            optimizer::GlobalOptimizer global(*arena, statements, symbols.size(), *report);
+            global.run();
+            optimizer::Fuser(*arena, statements, *report).run();
+            global.inferTypes();
+        }
+        // The optimizer changes the statements with what it knows of the whole program.
+        reusable = !optimize;
+    }
+
+    void Interpreter::rebuild() {
+        for (auto stmt: statements) {
+            delete stmt;
+        }
+        statements.clear();
+        arena->clear();
+        clearVariables();
+        edits.clear();
+        grown = 0;
+
+        std::vector<statement::RawStatement *> lines;
+        for (auto &rawStmt: *rawStatements) {
+            if (rawStmt.parsed == nullptr)
+                lines.push_back(&rawStmt);
+        }
+        parseLines(lines);
+
+        optimizer::Folder folder(*arena, *report);
+        for (auto &rawStmt: *rawStatements)
+            statements.push_back(build(rawStmt, optimize ? &folder : nullptr));
+
+        link({});
+    }
+
+    void Interpreter::update() {
+        std::vector<int> edited;
+        for (const Edit &edit: edits) {
+            switch (edit.kind) {
+                case Edit::INSERT:
+                    shift(edit.index, 1);
+                    statements.insert(statements.begin() + edit.index, nullptr);
+                    break;
+                case Edit::REPLACE:
+                    delete statements[edit.index];
+                    statements[edit.index] = nullptr;
+                    break;
+                case Edit::ERASE:
+                    delete statements[edit.index];
+                    statements.erase(statements.begin() + edit.index);
+                    // The jumps to the line itself are relinked.
+                    shift(edit.index + 1, -1);
+                    break;
+            }
+            edited.push_back(edit.lineno);
+        }
+        edits.clear();
+        std::sort(edited.begin(), edited.end());
+        edited.erase(std::unique(edited.begin(), edited.end()), edited.end());
+
+        std::vector<statement::RawStatement *> lines;
+        for (int lineno: edited) {
+            auto rawStmt = rawStatements->find(lineno);
+            if (rawStmt != nullptr && rawStmt->parsed == nullptr)
+                lines.push_back(rawStmt);
+        }
+        parseLines(lines);
+
+        for (int lineno: edited) {
+            auto rawStmt = rawStatements->find(lineno);
+            if (rawStmt == nullptr) continue;
+            int index = rawStatements->indexOf(lineno);
+            delete statements[index];
+            statements[index] = build(*rawStmt, nullptr);
+            grown += rawStmt->parsed->tree.nodes.size();
+        }
+
+        link(edited);
+    }
+
+    void Interpreter::shift(int from, int delta) {
+        for (auto stmt: statements) {
+            if (stmt == nullptr) continue;
+            syntax::Node &node = (*arena)[stmt->getSyntaxTree()->getRoot()];
+            if ((node.kind == syntax::GOTO_EXP || node.kind == syntax::IF_THEN_EXP) && node.value >= from)
+                node.value += delta;
+        }
+    }
+
+    // What a thread needs to parse lines on its own.
+    struct FrontEnd {
+        lexer::Lexer lexer;
+        parser::Parser parser;
+        syntax::Arena arena;
+        // Token buffer is reused, tokens only view the source lines.
+        std::vector <parser::Token> tokens;
+    };
+
+    void Interpreter::parseLines(const std::vector<statement::RawStatement *> &lines) {
+        int len = lines.size();
+        int count = threads > 0 ? threads : std::max(1, int(std::thread::hardware_concurrency()));
+        count = std::max(1, std::min(count, (len + PARSE_CHUNK - 1) / PARSE_CHUNK));
+
+        // Each line is parsed into its own cache, so the threads share nothing but the next chunk to take.
+        std::atomic<int> next(0);
+        auto work = [&]() {
+            FrontEnd frontEnd;
+            for (int start; (start = next.fetch_add(PARSE_CHUNK)) < len;) {
+                int end = std::min(start + PARSE_CHUNK, len);
+                for (int i = start; i < end; ++i)
+                    parseLine(*lines[i], frontEnd);
+            }
+        };
+        std::vector <std::thread> workers;
+        for (int i = 1; i < count; ++i)
+            workers.emplace_back(work);
+        work();
+        for (auto &worker: workers)
+            worker.join();
+    }
+
+    void Interpreter::parseLine(statement::RawStatement &rawStmt, FrontEnd &frontEnd) {
+        auto parsed = std::make_unique<statement::ParsedStatement>();
+        frontEnd.arena.clear();
+        auto mark = frontEnd.arena.mark();
+        statement::Statement *stmt = nullptr;
+        try {
+            frontEnd.lexer.scan(rawStmt.srcCode, frontEnd.tokens);
+            // Parse stmt.
+            stmt = frontEnd.parser.parse(&frontEnd.arena, rawStmt.lineno, rawStmt.srcCode, frontEnd.tokens);
+
+            stmt->checkValidation(this);
+
+            parsed->type = stmt->getType();
+            parsed->tree = frontEnd.arena.extract(mark, stmt->getSyntaxTree()->getRoot());
+        } catch (const char *errorMsg) {
+            parsed->errorMsg = errorMsg;
+        }
+        delete stmt;
+        rawStmt.parsed = std::move(parsed);
+    }
+
+    statement::Statement *Interpreter::build(statement::RawStatement &rawStmt, optimizer::Folder *folder) {
+        const auto &parsed = *rawStmt.parsed;
+        // Reported by link.
+        if (parsed.type == statement::STMT_INVALID)
+            return nullptr;
+        // The tree in the cache is left as parsed, the copy is the one to optimize and run.
+        auto tree = new syntax::SyntaxTree(arena.get(), arena->insert(parsed.tree));
+        auto stmt = statement::Statement::make(parsed.type, rawStmt.lineno, rawStmt.srcCode, tree);
+        try {
+            // Optimize the tree as parsed, the printed one stays as written.
+            if (folder != nullptr)
+                stmt->fold(folder);
+
+            // Resolve variables to slots.
+            stmt->resolve(this);
+        } catch (const std::string &errorMsg) {
+            std::cerr << errorMsg << std::endl;
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+        }
+        return stmt;
+    }
+
+    void Interpreter::link(const std::vector<int> &edited) {
+        std::string unresolved;
+        int len = statements.size();
+        for (int i = 0; i < len; ++i) {
+            auto stmt = statements[i];
+            if (stmt == nullptr) {
+                const auto &rawStmt = rawStatements->at(i);
+                console->parseError(i, rawStmt.lineno, rawStmt.parsed->errorMsg);
+                continue;
+            }
+            syntax::Node &node = (*arena)[stmt->getSyntaxTree()->getRoot()];
+            int lineno;
+            if (node.kind == syntax::GOTO_EXP)
+                lineno = (*arena)[node.left].value;
+            else if (node.kind == syntax::IF_THEN_EXP)
+                lineno = (*arena)[node.right].value;
+            else
+                continue;
+            // The others still point to the same line.
+            if (node.value < 0 || std::binary_search(edited.begin(), edited.end(), lineno))
+                stmt->link(this);
+            if (node.value >= 0) continue;
+            if (!unresolved.empty())
+                unresolved += '\n';
+            unresolved += "Line " + std::to_string(stmt->getLineno()) + ": Use non-existent line number "
+                          + std::to_string(lineno) + "!";
+        }
+
+        // Not an error yet, the jump may never be taken.
+        if (!unresolved.empty())
+            console->error(unresolved);
+    }
+
+    void Interpreter::run(long long budget) {
+        suspended = false;
+
+        if (runMode == BYTECODE) {
+            runBytecode(budget);
+            return;
+        }
+        if (runMode == JIT) {
+            runNative(budget);
+            return;
+        }
+
+        int len = statements.size();
+        // Special judge, if waiting for input, then break, until input complete.
+        while (stmtIdx < len && !suspended && budget-- > 0)
+            step();
+    }
+
+    void Interpreter::step() {
+        auto stmt = statements[stmtIdx];
+        int curIdx = stmtIdx;
+        try {
+            ++stmtIdx;
+
+            // stmt == nullptr means it's invalid.
+            if (stmt == nullptr) return;
+
+            // Run the stmt.
+            stmt->run(this);
+        } catch (const std::string &errorMsg) {
+            std::cerr << errorMsg << std::endl;
+        }
+        catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+        } catch (const char *errorMsg) {
+            runtimeError(curIdx, errorMsg);
+        }
+    }
+
+    void Interpreter::runBytecode(long long budget) {
+        if (machine == nullptr) {
+            program = bytecode::Compiler().compile(statements);
+            machine = std::make_unique<bytecode::Machine>(program.get());
+        }
+
+        machine->run(this, budget);
+
+        if (machine->isFinished())
+            end();
+        else
+            stmtIdx = machine->stmtIndex();
+    }
+
+    void Interpreter::runNative(long long budget) {
+        if (native == nullptr) {
+            native = jit::Compiler().compile(*arena, statements, symbols.size());
+            if (native == nullptr) {
+                runMode = BYTECODE;
+                runBytecode(budget);
+                return;
+            }
+        }
+
+        int len = statements.size();
+        while (stmtIdx < len && !suspended && budget > 0) {
+            int fuel = int(std::min<long long>(budget, INT_MAX));
+            int left = fuel;
+            stmtIdx = native->run(this, stmtIdx, left);
+            // Out of fuel at the head of a loop, which hasn't run yet.
+            if (left < 0) {
+                budget -= fuel;
+                continue;
+            }
+            budget -= fuel - left;
+            // Stopped at a statement for the tree walker.
+            if (stmtIdx < len) {
+                step();
+                --budget;
+            }
+        }
+    }
+
+    std::string Interpreter::transpile() const {
+        return transpiler::Transpiler().translate(*arena, statements, symbols);
+    }
+
+    void Interpreter::runImmediate(const std::string &cmdline) {
+        // Not a part of the program, so its nodes don't go to the program's arena.
+        syntax::Arena cmdArena;
+        auto tokens = lexer->scan(cmdline);
+        auto stmt = parser->parse(&cmdArena, 0, cmdline, tokens);
+        try {
+            stmt->resolve(this);
+            stmt->run(this);
+        } catch (...) {
+            delete stmt;
+            throw;
+        }
+        delete stmt;
+    }
+
+    void Interpreter::print(const std::string &str) {
+        console->print(str);
+    }
+
+    void Interpreter::input(const std::string &var) {
+        if (!console->input(var)) {
+            suspended = true;
+            awaiting = resolve(var);
+        }
+    }
+
+    void Interpreter::setInput(const std::string &var, const std::string &value) {
+        assign(resolve(var), value);
+    }
+
+    void Interpreter::feed(const std::string &value) {
+        if (awaiting < 0) return;
+        assign(awaiting, value);
+        awaiting = -1;
+    }
+
+    void Interpreter::assign(int slot, const std::string &value) {
+        static std::regex intFmt("([1-9][0-9]*)|0");
+        static std::regex strFmt("\".*\"");
+
+        if (std::regex_match(value, intFmt))
+            variables[slot].set(std::atoi(value.c_str()));
+        else if (std::regex_match(value, strFmt))
+            variables[slot].set(value.substr(1, value.size() - 2));
+        else
+            return;
+        if (machine != nullptr)
+            machine->reload(this, slot);
+    }
+
+    int Interpreter::resolve(const std::string &symbol) {
+        int *slot = symtab->look(symbol);
+        if (slot != nullptr)
+            return *slot;
+        int newSlot = symbols.size();
+        symtab->enter(symbol, newSlot);
+        symbols.push_back(symbol);
+        variables.emplace_back();
+        return newSlot;
+    }
+
+    env::Variable *Interpreter::lookup(std::string_view symbol) {
+        int *slot = symtab->look(symbol);
+        return slot != nullptr ? &variables[*slot] : nullptr;
+    }
+
+    void Interpreter::clearVariables() {
+        symtab->clear();
+        symbols.clear();
+        variables.clear();
+    }
+
+    int Interpreter::target(int lineno) {
+        auto rawStmt = rawStatements->find(lineno);
+        if (rawStmt == nullptr || rawStmt->parsed->type == statement::STMT_INVALID)
+            return -1;
+        return rawStatements->indexOf(lineno);
+    }
+
+    void Interpreter::jump(int index) {
+        if (index < 0)
+            throw "Use non-existent line number!";
+        stmtIdx = index;
+    }
+
+    void Interpreter::end() {
+        stmtIdx = statements.size();
+    }
+
+    void Interpreter::runtimeError(int index, const std::string &errorMsg) {
+        console->runtimeError(index, statements[index]->getLineno(), errorMsg);
+    }
+}
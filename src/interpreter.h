@@ -0,0 +1,304 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <climits>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <istream>
+#include "table.h"
+
+namespace statement {
+    class RawStatement;
+
+    class Statement;
+}
+
+namespace source {
+    class Listing;
+}
+
+namespace lexer {
+    class Lexer;
+}
+
+namespace parser {
+    class Parser;
+}
+
+namespace syntax {
+    class Arena;
+}
+
+namespace optimizer {
+    class Report;
+
+    class Folder;
+}
+
+namespace bytecode {
+    class Program;
+
+    class Machine;
+}
+
+namespace jit {
+    class Code;
+}
+
+namespace interpreter {
+    struct FrontEnd;
+
+    // The front-end (GUI, console, ...) the interpreter talks to.
+    class Console {
+    public:
+        virtual ~Console() = default;
+
+        // Output of PRINT.
+        virtual void print(const std::string &str) = 0;
+
+        // Request a value for the variable. Return true if the value has been fed
+        // synchronously, or false to suspend the interpreter until it is fed later.
+        virtual bool input(const std::string &var) = 0;
+
+        virtual void error(const std::string &errorMsg) = 0;
+
+        // The index-th statement can't be parsed.
+        virtual void parseError(int index, int lineno, const std::string &errorMsg) = 0;
+
+        // The index-th statement failed while running.
+        virtual void runtimeError(int index, int lineno, const std::string &errorMsg) = 0;
+    };
+
+    // How many times the fused forms of statements ran, see optimizer::Fuser.
+    struct FusedCounts {
+        long long increments = 0;
+        long long branches = 0;
+        long long gotos = 0;
+
+        std::string toString() const;
+    };
+
+    class Interpreter {
+    public:
+        enum RunMode {
+            // Walk the syntax trees, the reference implementation.
+            TREE,
+            // Compile the program to bytecode and run it on the stack machine.
+            BYTECODE,
+            // Compile the program to native code, the statements it can't run are left to the tree walker.
+            // Same as BYTECODE where there is no JIT.
+            JIT,
+        };
+
+        Interpreter(Console *console);
+
+        ~Interpreter();
+
+        // Symbol -> slot, only for resolving and accessing variables by name, e.g. PRINT x in command line.
+        std::unique_ptr <env::Table<std::string, int>> symtab;
+
+        // Symbol of each slot.
+        std::vector <std::string> symbols;
+
+        // Variables indexed by slot, all that execution touches.
+        std::vector <env::Variable> variables;
+
+        // Lines of the program in line number order.
+        std::unique_ptr <source::Listing> rawStatements;
+
+        std::vector<statement::Statement *> statements;
+
+        FusedCounts fused;
+
+        void addRawStatement(statement::RawStatement &&rawStmt);
+
+        void deleteLine(int lineno);
+
+        // Load the program, report invalid lines to the console.
+        void load(std::istream &in);
+
+        // Load the program from a file, mapped into memory where possible. false if it can't be opened.
+        bool loadFile(const std::string &path);
+
+        // Load the program from its text, the invalid lines are reported at once.
+        void loadText(std::string_view text);
+
+        // Drop the state of the last run, the variables are undefined again. The statements are kept for parse.
+        void init();
+
+        // Drop the whole program.
+        void clear();
+
+        // Parse the lines not parsed yet and build the program. Without the optimizer, the statements of the last
+        // parse are updated with the edits since, so only the edited lines are built. With it, every line's tree is
+        // copied out of its cache and the whole program is optimized and linked. The syntax trees aren't printed,
+        // a front-end prints the ones it shows from the lines' caches.
+        void parse();
+
+        // Slot of the symbol, a new one is assigned if it has none.
+        int resolve(const std::string &symbol);
+
+        // Access a variable by name, nullptr if it has no slot.
+        env::Variable *lookup(std::string_view symbol);
+
+        // Run from the current statement, until the end or an INPUT suspends it, or until about budget statements
+        // have run, so that it can be paused. The compiled modes only count the jumps taken, which every loop takes.
+        // Run again to go on.
+        void run(long long budget = LLONG_MAX);
+
+        inline bool isFinished() const {
+            return stmtIdx >= int(statements.size());
+        }
+
+        inline bool isSuspended() const {
+            return suspended;
+        }
+
+        inline void setRunMode(RunMode mode) {
+            runMode = mode;
+        }
+
+        // Threads to parse the program with, 0 for one per core.
+        inline void setThreads(int threads) {
+            this->threads = threads;
+        }
+
+        // Optimize the program after parsing, on by default.
+        inline void setOptimize(bool optimize) {
+            this->optimize = optimize;
+        }
+
+        // What the optimizer did to the program last parsed.
+        inline const optimizer::Report &getReport() const {
+            return *report;
+        }
+
+        // The program last parsed as a C++ translation unit, see transpiler::Transpiler.
+        std::string transpile() const;
+
+        // Run a single statement without line number, e.g. PRINT x in command line.
+        void runImmediate(const std::string &cmdline);
+
+        void print(const std::string &str);
+
+        void input(const std::string &var);
+
+        // Feed the value of variable requested by INPUT.
+        void setInput(const std::string &var, const std::string &value);
+
+        // Feed the value the suspended INPUT waits for. The next run goes on right after the INPUT, where it was
+        // suspended: the statement index or the pc of the machine, and only the variable fed is exchanged.
+        void feed(const std::string &value);
+
+        // Index of the statement of lineno, or -1 if there is none or it is invalid.
+        int target(int lineno);
+
+        // Continue with the index-th statement.
+        void jump(int index);
+
+        void end();
+
+        // The index-th statement failed while running.
+        void runtimeError(int index, const std::string &errorMsg);
+
+    private:
+        // Invalid lines listed by loadText, the others are only counted.
+        static const int MAX_LOAD_ERRORS = 20;
+
+        Console *console;
+
+        RunMode runMode = TREE;
+
+        bool optimize = true;
+
+        int threads = 0;
+
+        std::unique_ptr <bytecode::Program> program;
+
+        std::unique_ptr <bytecode::Machine> machine;
+
+        std::unique_ptr <jit::Code> native;
+
+        int stmtIdx = 0;
+
+        bool suspended = false;
+
+        // Slot of the variable the suspended INPUT waits for, -1 if none.
+        int awaiting = -1;
+
+        std::unique_ptr <lexer::Lexer> lexer;
+
+        std::unique_ptr <parser::Parser> parser;
+
+        // Nodes of the syntax trees of all the statements.
+        std::unique_ptr <syntax::Arena> arena;
+
+        std::unique_ptr <optimizer::Report> report;
+
+        void runBytecode(long long budget);
+
+        void runNative(long long budget);
+
+        // Run the current statement on the tree walker.
+        void step();
+
+        void clearVariables();
+
+        // Set the slot to an input value, and the machine's copy of it. A value of neither type is ignored.
+        void assign(int slot, const std::string &value);
+
+        // Lines a thread takes at a time.
+        static const int PARSE_CHUNK = 1024;
+
+        // An edit of the listing since the last parse, index is the line's position when it was made.
+        struct Edit {
+            enum Kind {
+                INSERT,
+                REPLACE,
+                ERASE,
+            } kind;
+            int index;
+            int lineno;
+        };
+
+        // More edits than that and the program is built again from the caches.
+        static const size_t MAX_EDITS = 64;
+
+        // The statements are those of the listing as last parsed without the optimizer, the edits since can be
+        // replayed on them.
+        bool reusable = false;
+
+        std::vector <Edit> edits;
+
+        // Nodes added to the arena by the updates, the ones of the statements they replace are left behind.
+        size_t grown = 0;
+
+        // Log the edit of lineno, before it is made.
+        void record(Edit::Kind kind, int lineno);
+
+        // Build every statement of the listing from the caches.
+        void rebuild();
+
+        // Replay the edits on the statements, build the edited lines and relink the jumps to them.
+        void update();
+
+        // Lex, parse and validate the lines, each into its cache, spread over the threads.
+        void parseLines(const std::vector<statement::RawStatement *> &lines);
+
+        void parseLine(statement::RawStatement &rawStmt, FrontEnd &frontEnd);
+
+        // Statement of the line copied from its cache into the arena, folded and resolved, or nullptr if invalid.
+        statement::Statement *build(statement::RawStatement &rawStmt, optimizer::Folder *folder);
+
+        // Move the jump targets from index on by delta, as a statement is inserted or erased before them.
+        void shift(int from, int delta);
+
+        // Resolve the jump targets not resolved yet and the ones to the lines edited, sorted. Report the invalid
+        // lines and the jumps to lines that don't exist at once.
+        void link(const std::vector<int> &edited);
+    };
+}
+
+#endif // INTERPRETER_H
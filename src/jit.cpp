@@ -0,0 +1,386 @@
+#include "jit.h"
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include "interpreter.h"
+#include "statement.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+namespace jit {
+    using namespace syntax;
+
+    // Condition codes of jcc and setcc.
+    enum Condition {
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_S = 0x8,
+        CC_L = 0xc,
+        CC_GE = 0xd,
+        CC_LE = 0xe,
+        CC_G = 0xf,
+    };
+
+    // Indexed by LogicOp.
+    static const int conditions[] = {CC_E, CC_NE, CC_G, CC_GE, CC_L, CC_LE};
+
+    // Called from the native code, return 1 if the console ended the program.
+    static int nativePrint(interpreter::Interpreter *interpreter, int value) {
+        interpreter->print(std::to_string(value));
+        return interpreter->isFinished();
+    }
+
+    // 0 ** x with x <= 0 is checked before, so it doesn't throw.
+    static int nativePow(int left, int right) {
+        return applyArithmetic(INDEX_OP, left, right);
+    }
+
+    Code::Code(void *memory, size_t size, std::vector<int> entries, int slotCount)
+            : memory(memory), size(size), cells(slotCount + 1) {
+        for (int offset: entries)
+            this->entries.push_back(static_cast<uint8_t *>(memory) + offset);
+    }
+
+    Code::~Code() {
+#ifdef JIT_X86_64
+        munmap(memory, size);
+#endif
+    }
+
+    int Code::run(interpreter::Interpreter *interpreter, int index, int &fuel) {
+        // The interpreter may have changed the variables, e.g. INPUT.
+        Cell *variables = cells.data() + 1;
+        int len = cells.size() - 1;
+        for (int i = 0; i < len; ++i) {
+            const env::Variable &variable = interpreter->variables[i];
+            if (!variable.defined)
+                variables[i] = Cell{0, UNDEFINED};
+            else if (variable.type == env::INT)
+                variables[i] = Cell{variable.value.getInt(), INT};
+            else
+                variables[i] = Cell{0, OTHER};
+        }
+        cells[0].iVal = fuel;
+
+        using Native = int (*)(Cell *, const void *const *, interpreter::Interpreter *, int);
+        index = reinterpret_cast<Native>(memory)(variables, entries.data(), interpreter, index);
+
+        for (int i = 0; i < len; ++i) {
+            if (variables[i].type == INT)
+                interpreter->variables[i].set(variables[i].iVal);
+        }
+        fuel = cells[0].iVal;
+        return index;
+    }
+
+    // The statement node jumps to, -1 if it doesn't.
+    static int jumpTarget(const Node &node) {
+        switch (node.kind) {
+            case LET_EXP:
+            case INC_EXP:
+                return node.op ? node.value : -1;
+            case GOTO_EXP:
+            case IF_THEN_EXP:
+            case BRANCH_EXP:
+                return node.value;
+            default:
+                return -1;
+        }
+    }
+
+    std::unique_ptr <Code> Compiler::compile(const Arena &arena, const std::vector<statement::Statement *> &statements,
+                                             int slotCount) {
+#ifndef JIT_X86_64
+        (void) arena;
+        (void) statements;
+        (void) slotCount;
+        return nullptr;
+#else
+        this->arena = &arena;
+        code.clear();
+        jumps.clear();
+        exits.clear();
+        int len = statements.size();
+        labels.assign(len + 1, 0);
+
+        // int run(Cell *cells, const void *const *entries, Interpreter *interpreter, int index),
+        // rbx holds the cells and r12 the interpreter, the stack stays 16-byte aligned between exps.
+        // The fuel is the cell before the variables.
+        emit({0x55});                   // push rbp
+        emit({0x48, 0x89, 0xe5});       // mov rbp, rsp
+        emit({0x53});                   // push rbx
+        emit({0x41, 0x54});             // push r12
+        emit({0x48, 0x89, 0xfb});       // mov rbx, rdi
+        emit({0x49, 0x89, 0xd4});       // mov r12, rdx
+        emit({0x89, 0xc9});             // mov ecx, ecx
+        emit({0xff, 0x24, 0xce});       // jmp [rsi + rcx * 8]
+
+        // Return eax, the values an exp may have left on the stack are dropped.
+        leave = code.size();
+        emit({0x48, 0x8d, 0x65, 0xf0}); // lea rsp, [rbp - 16]
+        emit({0x41, 0x5c});             // pop r12
+        emit({0x5b});                   // pop rbx
+        emit({0x5d});                   // pop rbp
+        emit({0xc3});                   // ret
+
+        // Every loop jumps back to its head, a statement jumped to from itself or below.
+        std::vector<bool> heads(len, false);
+        for (int i = 0; i < len; ++i) {
+            int target = statements[i] ? jumpTarget(arena[statements[i]->getSyntaxTree()->getRoot()]) : -1;
+            if (target >= 0 && target <= i)
+                heads[target] = true;
+        }
+
+        for (current = 0; current < len; ++current) {
+            labels[current] = code.size();
+            depth = 0;
+            if (heads[current])
+                takeFuel();
+            if (statements[current])
+                compileStatement(arena[statements[current]->getSyntaxTree()->getRoot()]);
+        }
+        labels[len] = code.size();
+        emit({0xb8});                   // mov eax, len
+        emit32(len);
+        emit({0xe9});                   // jmp leave
+        emit32(leave - int(code.size() + 4));
+
+        for (const auto &jump: jumps) {
+            int32_t rel = labels[jump.second] - (jump.first + 4);
+            std::memcpy(&code[jump.first], &rel, 4);
+        }
+        // One stub per statement stopped at, return its index.
+        std::vector<int> stubs(len, -1);
+        for (const auto &exit: exits) {
+            int &stub = stubs[exit.second];
+            if (stub < 0) {
+                stub = code.size();
+                emit({0xb8});
+                emit32(exit.second);
+                emit({0xe9});
+                emit32(leave - int(code.size() + 4));
+            }
+            int32_t rel = stub - (exit.first + 4);
+            std::memcpy(&code[exit.first], &rel, 4);
+        }
+
+        size_t size = code.size();
+        void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return nullptr;
+        std::memcpy(memory, code.data(), size);
+        if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, size);
+            return nullptr;
+        }
+        return std::make_unique<Code>(memory, size, labels, slotCount);
+#endif
+    }
+
+    void Compiler::compileStatement(const Node &node) {
+        const Arena &arena = *this->arena;
+        switch (node.kind) {
+            case LET_EXP: {
+                if (arena[node.right].kind == STRING_EXP) {
+                    exitIf();
+                    break;
+                }
+                int slot = arena[node.left].value;
+                compileExp(node.right);
+                emitCell(0x89, 0x83, slot, 0);                  // mov [cell], eax
+                emitCell(0xc7, 0x83, slot, offsetof(Cell, type)); // mov dword [cell.type], INT
+                emit32(INT);
+                if (node.op)
+                    jumpTo(node.value);
+                break;
+            }
+            case INC_EXP: {
+                int slot = arena[node.left].value;
+                if (!node.intOnly)
+                    checkInt(slot);
+                emitCell(0x81, 0x83, slot, 0);                  // add dword [cell], c
+                emit32(arena[node.right].value);
+                if (node.op)
+                    jumpTo(node.value);
+                break;
+            }
+            case PRINT_EXP:
+                if (arena[node.left].kind == STRING_EXP) {
+                    exitIf();
+                    break;
+                }
+                compileExp(node.left);
+                emit({0x89, 0xc6});                             // mov esi, eax
+                emit({0x4c, 0x89, 0xe7});                       // mov rdi, r12
+                callNative(reinterpret_cast<const void *>(&nativePrint));
+                emit({0x85, 0xc0});                             // test eax, eax
+                jumpTo(labels.size() - 1, CC_NE);
+                break;
+            case GOTO_EXP:
+                jumpTo(node.value);
+                break;
+            case END_EXP:
+                jumpTo(labels.size() - 1);
+                break;
+            case IF_THEN_EXP:
+                compileExp(node.left);
+                emit({0x83, 0xf8, 0x01});                       // cmp eax, 1
+                jumpTo(node.value, CC_E);
+                break;
+            case BRANCH_EXP: {
+                const Node &test = arena[node.left];
+                int slot = arena[test.left].value;
+                if (!node.intOnly)
+                    checkInt(slot);
+                emitCell(0x81, 0xbb, slot, 0);                  // cmp dword [cell], c
+                emit32(arena[test.right].value);
+                jumpTo(node.value, conditions[test.op]);
+                break;
+            }
+            case INPUT_EXP:
+                exitIf();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void Compiler::compileExp(NodeId exp) {
+        const Node &node = (*arena)[exp];
+        switch (node.kind) {
+            case INT_EXP:
+                emit({0xb8});                                   // mov eax, value
+                emit32(node.value);
+                break;
+            case VAR_EXP:
+                if (!node.intOnly)
+                    checkInt(node.value);
+                emitCell(0x8b, 0x83, node.value, 0);            // mov eax, [cell]
+                break;
+            case ARITHMETIC_EXP:
+            case LOGICAL_EXP:
+                compileBinary(node);
+                break;
+            default:
+                // A string in an operation, the interpreter reports it.
+                exitIf();
+                break;
+        }
+    }
+
+    void Compiler::compileBinary(const Node &node) {
+        compileExp(node.left);
+        emit({0x50});                                           // push rax
+        ++depth;
+        compileExp(node.right);
+        emit({0x89, 0xc1});                                     // mov ecx, eax
+        emit({0x58});                                           // pop rax
+        --depth;
+
+        if (node.kind == LOGICAL_EXP) {
+            emit({0x39, 0xc8});                                 // cmp eax, ecx
+            emit({0x0f, uint8_t(0x90 | conditions[node.op])}); // setcc al
+            emit({0xc0});
+            emit({0x0f, 0xb6, 0xc0});                           // movzx eax, al
+            return;
+        }
+        switch (node.op) {
+            case PLUS_OP:
+                emit({0x01, 0xc8});                             // add eax, ecx
+                break;
+            case MINUS_OP:
+                emit({0x29, 0xc8});                             // sub eax, ecx
+                break;
+            case TIMES_OP:
+                emit({0x0f, 0xaf, 0xc1});                       // imul eax, ecx
+                break;
+            case DIVIDE_OP:
+                // Division by zero fails, INT_MIN / -1 traps, both are left to the interpreter.
+                emit({0x85, 0xc9});                             // test ecx, ecx
+                exitIf(CC_E);
+                emit({0x83, 0xf9, 0xff});                       // cmp ecx, -1
+                exitIf(CC_E);
+                emit({0x99});                                   // cdq
+                emit({0xf7, 0xf9});                             // idiv ecx
+                break;
+            case INDEX_OP: {
+                // 0 ** x with x <= 0 fails.
+                emit({0x85, 0xc0});                             // test eax, eax
+                emit({0x75, 0x00});                             // jnz call
+                int skip = code.size();
+                emit({0x85, 0xc9});                             // test ecx, ecx
+                exitIf(CC_LE);
+                code[skip - 1] = uint8_t(code.size() - skip);
+                emit({0x89, 0xc7});                             // mov edi, eax
+                emit({0x89, 0xce});                             // mov esi, ecx
+                callNative(reinterpret_cast<const void *>(&nativePow));
+                break;
+            }
+        }
+    }
+
+    void Compiler::checkInt(int slot) {
+        emitCell(0x83, 0xbb, slot, offsetof(Cell, type));      // cmp dword [cell.type], INT
+        emit({uint8_t(INT)});
+        exitIf(CC_NE);
+    }
+
+    void Compiler::takeFuel() {
+        emit({0x83, 0x6b, 0xf8, 0x01});                         // sub dword [rbx - 8], 1
+        exitIf(CC_S);
+    }
+
+    void Compiler::callNative(const void *function) {
+        bool align = depth % 2 != 0;
+        if (align)
+            emit({0x48, 0x83, 0xec, 0x08});                     // sub rsp, 8
+        emit({0x48, 0xb8});                                     // mov rax, function
+        uint64_t address = reinterpret_cast<uint64_t>(function);
+        for (int i = 0; i < 8; ++i)
+            code.push_back(uint8_t(address >> (8 * i)));
+        emit({0xff, 0xd0});                                     // call rax
+        if (align)
+            emit({0x48, 0x83, 0xc4, 0x08});                     // add rsp, 8
+    }
+
+    void Compiler::emit(std::initializer_list <uint8_t> bytes) {
+        code.insert(code.end(), bytes);
+    }
+
+    void Compiler::emit32(int32_t value) {
+        uint8_t bytes[4];
+        std::memcpy(bytes, &value, 4);
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+
+    void Compiler::emitCell(uint8_t op, uint8_t modrm, int slot, int offset) {
+        // op [rbx + disp32]
+        emit({op, modrm});
+        emit32(slot * int(sizeof(Cell)) + offset);
+    }
+
+    void Compiler::jumpTo(int index, int cc) {
+        if (index < 0) {
+            exitIf(cc);
+            return;
+        }
+        if (cc < 0)
+            emit({0xe9});
+        else
+            emit({0x0f, uint8_t(0x80 | cc)});
+        jumps.emplace_back(code.size(), index);
+        emit32(0);
+    }
+
+    void Compiler::exitIf(int cc) {
+        if (cc < 0)
+            emit({0xe9});
+        else
+            emit({0x0f, uint8_t(0x80 | cc)});
+        exits.emplace_back(code.size(), current);
+        emit32(0);
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "syntax.h"
+
+namespace statement {
+    class Statement;
+}
+
+namespace jit {
+    enum CellType : int32_t {
+        UNDEFINED,
+        INT,
+        // A string, it stays with the interpreter.
+        OTHER,
+    };
+
+    // A variable as the native code sees it.
+    struct Cell {
+        int32_t iVal;
+        CellType type;
+    };
+
+    // Native code of a program. It runs the int statements, and stops at a statement it leaves to the
+    // interpreter: INPUT, strings, and any statement that is going to fail, which is run again from its
+    // start by the interpreter to report the error. A statement only takes effect at its end, so that is safe.
+    class Code {
+    public:
+        Code(void *memory, size_t size, std::vector<int> entries, int slotCount);
+
+        ~Code();
+
+        Code(const Code &) = delete;
+
+        Code &operator=(const Code &) = delete;
+
+        // Run from the index-th statement, return the index of the statement left to the interpreter,
+        // or the number of statements if the program is over. A unit of fuel is taken at the head of each loop,
+        // it stops there, before the statement, with the fuel at -1 if there is none left.
+        int run(interpreter::Interpreter *interpreter, int index, int &fuel);
+
+    private:
+        void *memory;
+
+        size_t size;
+
+        // Native address of each statement, and of the end of the program.
+        std::vector<const void *> entries;
+
+        // The fuel, then the variables by slot, exchanged with the interpreter's around each run.
+        std::vector <Cell> cells;
+    };
+
+    // Translate a linked program to x86-64, with no toolchain at runtime.
+    class Compiler {
+    public:
+        Compiler() = default;
+
+        // nullptr if there is no JIT on this platform.
+        std::unique_ptr <Code> compile(const syntax::Arena &arena, const std::vector<statement::Statement *> &statements,
+                                       int slotCount);
+
+    private:
+        const syntax::Arena *arena = nullptr;
+
+        std::vector <uint8_t> code;
+
+        // Offset of the code of each statement, and of the end of the program.
+        std::vector<int> labels;
+
+        // Offsets of rel32 to patch, with the statement they go to, or stop at for exits.
+        std::vector <std::pair<int, int>> jumps;
+
+        std::vector <std::pair<int, int>> exits;
+
+        int leave = 0;
+
+        // Statement being compiled.
+        int current = 0;
+
+        // Values pushed on the native stack by the exp being compiled.
+        int depth = 0;
+
+        void compileStatement(const syntax::Node &node);
+
+        // Leave the value of exp in eax.
+        void compileExp(syntax::NodeId exp);
+
+        void compileBinary(const syntax::Node &node);
+
+        // Stop at the current statement unless the slot holds an int.
+        void checkInt(int slot);
+
+        // Take a unit of fuel, stop at the current statement if there is none left.
+        void takeFuel();
+
+        void callNative(const void *function);
+
+        void emit(std::initializer_list <uint8_t> bytes);
+
+        void emit32(int32_t value);
+
+        void emitCell(uint8_t op, uint8_t modrm, int slot, int offset);
+
+        // jmp, or jcc with the condition code cc, to the index-th statement, a missing one fails.
+        void jumpTo(int index, int cc = -1);
+
+        // jmp, or jcc, to stop at the current statement.
+        void exitIf(int cc = -1);
+    };
+}
+
+#endif // JIT_H
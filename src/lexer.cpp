@@ -2,28 +2,112 @@
 #include <iostream>
 
 namespace lexer {
+    parser::TokenType Lexer::matchWord(const std::string &code, int start, int end) {
+        int len = end - start;
+        for (const auto &keywordAndTy: keywords) {
+            const std::string &keyword = keywordAndTy.first;
+            if (int(keyword.size()) == len && code.compare(start, len, keyword) == 0)
+                return keywordAndTy.second;
+        }
+        return parser::ID;
+    }
+
     parser::Token Lexer::matchLongest(const std::string &code, int start) {
-        std::string lex;
-        int matched_idx = start;
-        parser::TokenType matchedType;
         int len = code.size();
-        for (int i = start; i < len; ++i) {
-            lex += code[i];
-            parser::TokenType thisType = match(lex);
-            if (thisType != parser::INVALID) {
-                matched_idx = i + 1;
-                matchedType = thisType;
+        int cur = start + 1;
+        parser::TokenType matchedType = parser::INVALID;
+
+        auto next = [&](int idx) { return idx < len ? charClass(code[idx]) : CH_OTHER; };
+
+        switch (charClass(code[start])) {
+            case CH_BLANK:
+                while (next(cur) == CH_BLANK) ++cur;
+                matchedType = parser::BLANK;
+                break;
+            case CH_ALPHA:
+                while (next(cur) == CH_ALPHA || next(cur) == CH_DIGIT) ++cur;
+                if (code.compare(start, 3, "REM") == 0) {
+                    // REM.* takes the rest of the line, '.' doesn't match line terminators.
+                    while (cur < len && code[cur] != '\n' && code[cur] != '\r') ++cur;
+                    matchedType = parser::REM;
+                } else {
+                    matchedType = matchWord(code, start, cur);
+                }
+                break;
+            case CH_DIGIT:
+                while (next(cur) == CH_DIGIT) ++cur;
+                matchedType = parser::INT;
+                break;
+            case CH_LPAREN: {
+                // (123) and (-123) are integers, otherwise it's a single parenthesis.
+                int end = next(cur) == CH_MINUS ? cur + 1 : cur;
+                if (next(end) == CH_DIGIT) {
+                    while (next(end) == CH_DIGIT) ++end;
+                    if (next(end) == CH_RPAREN) {
+                        cur = end + 1;
+                        matchedType = parser::INT;
+                        break;
+                    }
+                }
+                matchedType = parser::LPAREN;
+                break;
             }
+            case CH_RPAREN:
+                matchedType = parser::RPAREN;
+                break;
+            case CH_EQ:
+                matchedType = parser::EQ;
+                break;
+            case CH_LT:
+                if (next(cur) == CH_EQ) {
+                    ++cur;
+                    matchedType = parser::LE;
+                } else if (next(cur) == CH_GT) {
+                    ++cur;
+                    matchedType = parser::NEQ;
+                } else {
+                    matchedType = parser::LT;
+                }
+                break;
+            case CH_GT:
+                if (next(cur) == CH_EQ) {
+                    ++cur;
+                    matchedType = parser::GE;
+                } else {
+                    matchedType = parser::GT;
+                }
+                break;
+            case CH_PLUS:
+                matchedType = parser::PLUS;
+                break;
+            case CH_MINUS:
+                matchedType = parser::MINUS;
+                break;
+            case CH_TIMES:
+                if (next(cur) == CH_TIMES) {
+                    ++cur;
+                    matchedType = parser::INDEX;
+                } else {
+                    matchedType = parser::TIMES;
+                }
+                break;
+            case CH_DIVIDE:
+                matchedType = parser::DIVIDE;
+                break;
+            default:
+                break;
         }
-        if (matched_idx == start) {
-            return parser::Token(code.substr(start, 1), parser::INVALID);
-        } else {
-            return parser::Token(code.substr(start, matched_idx - start), matchedType);
-        }
+        return parser::Token(std::string_view(code).substr(start, cur - start), matchedType);
     }
 
     std::vector <parser::Token> Lexer::scan(const std::string &code) const {
         std::vector <parser::Token> tokens;
+        scan(code, tokens);
+        return tokens;
+    }
+
+    void Lexer::scan(const std::string &code, std::vector <parser::Token> &tokens) const {
+        tokens.clear();
         int cur = 0;
         int len = code.size();
         while (cur < len) {
@@ -38,13 +122,18 @@ namespace lexer {
                 if (type == parser::INT) {
                     if (token.tok[0] == '(') { // remove the parenthesis
                         token.tok = token.tok.substr(1, token.tok.size() - 2);
+                        token.value = decodeInt(token.tok);
                     } else {
+                        token.value = decodeInt(token.tok);
                         int len = tokens.size();
                         if (len > 2 && tokens[len - 1].type == parser::MINUS &&
                             (tokens[len - 2].type == parser::PRINT || tokens[len - 2].type == parser::EQ)) {
                             // special judge, the negative number at the beginning
-                            tokens[len - 1].type = parser::INT;
-                            tokens[len - 1].tok += token.tok;
+                            parser::Token &minus = tokens[len - 1];
+                            minus.type = parser::INT;
+                            minus.tok = std::string_view(minus.tok.data(),
+                                                         token.tok.data() + token.tok.size() - minus.tok.data());
+                            minus.value = int(-std::strtol(token.tok.data(), nullptr, 10));
                             continue;
                         }
                     }
@@ -52,58 +141,40 @@ namespace lexer {
                 tokens.push_back(token);
             }
         }
-        return tokens;
     }
 
-    const std::string Lexer::blankFmt = "\\s+";
-    const std::string Lexer::letFmt = "LET";
-    const std::string Lexer::ifFmt = "IF";
-    const std::string Lexer::thenFmt = "THEN";
-    const std::string Lexer::gotoFmt = "GOTO";
-    const std::string Lexer::printFmt = "PRINT";
-    const std::string Lexer::remFmt = "REM.*";
-    const std::string Lexer::endFmt = "END";
-    const std::string Lexer::inputFmt = "INPUT";
-    const std::string Lexer::idFmt = "[a-zA-Z][a-zA-Z0-9]*";
-    const std::string Lexer::intFmt = "[0-9]+|(\\((\\-)?[0-9]+\\))";
-    const std::string Lexer::eqFmt = "=";
-    const std::string Lexer::ltFmt = "\\<";
-    const std::string Lexer::leFmt = "\\<=";
-    const std::string Lexer::neqFmt = "\\<\\>";
-    const std::string Lexer::gtFmt = "\\>";
-    const std::string Lexer::geFmt = "\\>=";
-    const std::string Lexer::plusFmt = "\\+";
-    const std::string Lexer::minusFmt = "\\-";
-    const std::string Lexer::timesFmt = "\\*";
-    const std::string Lexer::divideFmt = "/";
-    const std::string Lexer::indexFmt = "\\*\\*";
-    const std::string Lexer::lparenFmt = "\\(";
-    const std::string Lexer::rparenFmt = "\\)";
+    static std::array<CharClass, 256> makeCharClasses() {
+        std::array<CharClass, 256> classes{};
+        classes.fill(CH_OTHER);
+        for (char ch: std::string(" \t\n\v\f\r"))
+            classes[static_cast<unsigned char>(ch)] = CH_BLANK;
+        for (int ch = 'a'; ch <= 'z'; ++ch)
+            classes[ch] = CH_ALPHA;
+        for (int ch = 'A'; ch <= 'Z'; ++ch)
+            classes[ch] = CH_ALPHA;
+        for (int ch = '0'; ch <= '9'; ++ch)
+            classes[ch] = CH_DIGIT;
+        classes['='] = CH_EQ;
+        classes['<'] = CH_LT;
+        classes['>'] = CH_GT;
+        classes['+'] = CH_PLUS;
+        classes['-'] = CH_MINUS;
+        classes['*'] = CH_TIMES;
+        classes['/'] = CH_DIVIDE;
+        classes['('] = CH_LPAREN;
+        classes[')'] = CH_RPAREN;
+        return classes;
+    }
+
+    const std::array<CharClass, 256> Lexer::charClasses = makeCharClasses();
 
-    std::vector <std::pair<std::string, parser::TokenType>> Lexer::fmtAndType = {
-            {blankFmt,  parser::BLANK},
-            {letFmt,    parser::LET},
-            {ifFmt,     parser::IF},
-            {thenFmt,   parser::THEN},
-            {gotoFmt,   parser::GOTO},
-            {printFmt,  parser::PRINT},
-            {remFmt,    parser::REM},
-            {endFmt,    parser::END},
-            {inputFmt,  parser::INPUT},
-            {idFmt,     parser::ID},
-            {intFmt,    parser::INT},
-            {eqFmt,     parser::EQ},
-            {ltFmt,     parser::LT},
-            {leFmt,     parser::LE},
-            {neqFmt,    parser::NEQ},
-            {gtFmt,     parser::GT},
-            {geFmt,     parser::GE},
-            {plusFmt,   parser::PLUS},
-            {minusFmt,  parser::MINUS},
-            {timesFmt,  parser::TIMES},
-            {divideFmt, parser::DIVIDE},
-            {indexFmt,  parser::INDEX},
-            {lparenFmt, parser::LPAREN},
-            {rparenFmt, parser::RPAREN},
+    const std::vector <std::pair<std::string, parser::TokenType>> Lexer::keywords = {
+            {"LET",   parser::LET},
+            {"IF",    parser::IF},
+            {"THEN",  parser::THEN},
+            {"GOTO",  parser::GOTO},
+            {"PRINT", parser::PRINT},
+            {"END",   parser::END},
+            {"INPUT", parser::INPUT},
     };
 }
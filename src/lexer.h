@@ -1,61 +1,61 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <array>
+#include <cstdlib>
 #include <string>
-#include <regex>
 #include <utility>
 #include <vector>
 #include "parser.h"
 
 namespace lexer {
+    // Character classes of the scanner, each byte of the source maps to one of them.
+    enum CharClass : unsigned char {
+        CH_OTHER,
+        CH_BLANK,
+        CH_ALPHA,
+        CH_DIGIT,
+        CH_EQ,
+        CH_LT,
+        CH_GT,
+        CH_PLUS,
+        CH_MINUS,
+        CH_TIMES,
+        CH_DIVIDE,
+        CH_LPAREN,
+        CH_RPAREN,
+    };
+
     class Lexer {
     public:
         Lexer() = default;
 
+        // Tokens view into code, so code must outlive them.
         std::vector <parser::Token> scan(const std::string &code) const;
 
-    private:
-        static inline bool isMatched(const std::string &fmt, const std::string &lex) {
-            return std::regex_match(lex, std::regex(fmt));
-        }
+        // Scan into tokens, so that the buffer can be reused across lines.
+        void scan(const std::string &code, std::vector <parser::Token> &tokens) const;
 
+    private:
+        // Longest match at start, ties are broken in favor of keywords, same as the former regex table:
+        //   \s+, LET, IF, THEN, GOTO, PRINT, REM.*, END, INPUT, [a-zA-Z][a-zA-Z0-9]*,
+        //   [0-9]+|(\((\-)?[0-9]+\)), =, <, <=, <>, >, >=, +, -, *, /, **, (, )
         static parser::Token matchLongest(const std::string &code, int start);
 
-        static inline parser::TokenType match(const std::string &lex) {
-            for (const auto &fmtAndTy: fmtAndType) {
-                if (isMatched(fmtAndTy.first, lex)) {
-                    return fmtAndTy.second;
-                }
-            }
-            return parser::INVALID;
+        static parser::TokenType matchWord(const std::string &code, int start, int end);
+
+        // Same as std::atoi, the digits are followed by a non-digit or the end of the source line.
+        static inline int decodeInt(std::string_view digits) {
+            return int(std::strtol(digits.data(), nullptr, 10));
+        }
+
+        static inline CharClass charClass(char ch) {
+            return charClasses[static_cast<unsigned char>(ch)];
         }
 
-        static std::vector <std::pair<std::string, parser::TokenType>> fmtAndType;
-
-        static const std::string blankFmt;
-        static const std::string letFmt;
-        static const std::string ifFmt;
-        static const std::string thenFmt;
-        static const std::string gotoFmt;
-        static const std::string printFmt;
-        static const std::string remFmt;
-        static const std::string endFmt;
-        static const std::string inputFmt;
-        static const std::string idFmt;
-        static const std::string intFmt;
-        static const std::string eqFmt;
-        static const std::string ltFmt;
-        static const std::string leFmt;
-        static const std::string neqFmt;
-        static const std::string gtFmt;
-        static const std::string geFmt;
-        static const std::string plusFmt;
-        static const std::string minusFmt;
-        static const std::string timesFmt;
-        static const std::string divideFmt;
-        static const std::string indexFmt;
-        static const std::string lparenFmt;
-        static const std::string rparenFmt;
+        static const std::array<CharClass, 256> charClasses;
+
+        static const std::vector <std::pair<std::string, parser::TokenType>> keywords;
     };
 }
 
@@ -2,29 +2,31 @@
 #include "ui_mainwindow.h"
 #include <QString>
 #include <iostream>
-#include <fstream>
 #include <QMessageBox>
 #include <QFileDialog>
-#include <future>
+#include <chrono>
+#include <regex>
 #include "stringutils.h"
 #include "statement.h"
-#include "lexer.h"
-#include "parser.h"
-#include "table.h"
-
-using Statement = statement::Statement;
-using Lexer = lexer::Lexer;
-using Parser = parser::Parser;
+#include "source.h"
 
 MainWindow::MainWindow(QWidget *parent)
         : QMainWindow(parent),
           ui(new Ui::MainWindow),
-          venv(std::make_unique<env::Table<std::string, env::Value>>()),
-          tenv(std::make_unique<env::Table<std::string, env::ValueType>>()),
-          lexer(std::make_unique<Lexer>()), parser(std::make_unique<Parser>()) {
+          interpreter(std::make_unique<interpreter::Interpreter>(this)) {
     ui->setupUi(this);
 
-    ui->codeDisplay->setLineWrapMode(QTextBrowser::NoWrap);
+    codeModel = new CodeModel(interpreter.get(), this);
+    ui->codeDisplay->setModel(codeModel);
+    treeModel = new TreeModel(interpreter.get(), this);
+    ui->treeDisplay->setModel(treeModel);
+    ui->resultBrowser->document()->setMaximumBlockCount(OUTPUT_LINES);
+
+    frameTimer = new QTimer(this);
+    QApplication::connect(frameTimer, &QTimer::timeout, this, &MainWindow::pollEvents);
+    frameTimer->start(16);
+
+    worker = std::thread(&MainWindow::serve, this);
 
     QApplication::connect(ui->btnLoadCode, &QPushButton::clicked, this, &MainWindow::load);
     QApplication::connect(ui->btnRunCode, &QPushButton::clicked, this, &MainWindow::run);
@@ -33,22 +35,31 @@ MainWindow::MainWindow(QWidget *parent)
 }
 
 MainWindow::~MainWindow() {
+    request = STOP;
+    closing = true;
+    {
+        std::lock_guard <std::mutex> lock(jobMtx);
+        job = Job{Job::QUIT};
+    }
+    jobCv.notify_one();
+    worker.join();
     delete ui;
 }
 
 void MainWindow::controlCmdlineInput() {
-    {
-        std::lock_guard <std::mutex> lock(mtx);
-        if (runningState != INPUT) return;
-    }
+    if (runningState != INPUT) return;
     std::string cmdline = ui->cmdLineEdit->text().trimmed().toStdString();
     if (!StringUtils::startWith(cmdline, "? ")) {
         ui->cmdLineEdit->setText("? ");
     }
 }
 
+void MainWindow::warning(const std::string &warningMsg) {
+    QMessageBox::warning(this, "Warning", QString::fromStdString(warningMsg), QMessageBox::Ok);
+}
+
 void MainWindow::error(const std::string &errorMsg) {
-    QMessageBox::warning(this, "Warning", QString::fromStdString(errorMsg), QMessageBox::Ok);
+    post(Event{Event::MESSAGE, 0, 0, errorMsg});
 }
 
 void MainWindow::error(const char *format ...) {
@@ -87,45 +98,15 @@ void MainWindow::error(const char *format ...) {
         }
     }
     va_end(ap); /* clean up when done */
-    error(result);
-}
-
-void MainWindow::addRawStatement(RawStatement *rawStmt) {
-    int tgtLineno = rawStmt->lineno;
-    auto it = rawStatements.begin();
-    for (; it != rawStatements.end(); ++it) {
-        int curLineno = (*it)->lineno;
-        if (curLineno > tgtLineno) {
-            break;
-        } else if (curLineno == tgtLineno) {
-            (*it)->srcCode = rawStmt->srcCode;
-            delete rawStmt;
-            return;
-        }
-    }
-    rawStatements.insert(it, rawStmt);
+    warning(result);
 }
 
 void MainWindow::init() {
-    for (auto stmt: statements) {
-        delete stmt;
-    }
-    statements.clear();
-    ui->treeDisplay->clear();
+    interpreter->init();
+    treeModel->detach();
+    outputSink.clear();
     ui->resultBrowser->clear();
-
-    venv->clear();
-    tenv->clear();
-
-    stmtIdx = 0;
-
-    QTextCursor cursor = ui->codeDisplay->textCursor();
-    cursor.movePosition(QTextCursor::Start, QTextCursor::MoveAnchor);
-    cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
-    QTextCharFormat charFormat;
-    charFormat.setBackground(Qt::white);
-    cursor.setCharFormat(charFormat);
-    cursor.clearSelection();
+    codeModel->clearMarks();
 }
 
 void MainWindow::info(const std::string &infoMsg) {
@@ -135,163 +116,219 @@ void MainWindow::info(const std::string &infoMsg) {
 void MainWindow::help() {
     std::string infoMsg;
     infoMsg += "Command List: \n";
-    infoMsg += "RUN: run the code.\n";
+    infoMsg += "RUN: run the code, or go on with it after PAUSE.\n";
+    infoMsg += "STOP: stop the running code.\n";
+    infoMsg += "PAUSE: pause the running code.\n";
     infoMsg += "LIST: not supported here, do nothing.\n";
     infoMsg += "CLEAR: clear the code and the result.\n";
     infoMsg += "LOAD: load code from disk.\n";
     infoMsg += "HELP: get help tips.\n";
     infoMsg += "INPUT: input a variable. Format: INPUT [variable_name]. e.g., INPUT x\n";
     infoMsg += "PRINT: print the value of given variable. Format: PRINT [variable_name]. e.g PRINT x\n";
+    infoMsg += "OUTPUT: also write the whole output to a file. Format: OUTPUT [file_name], OUTPUT alone stops it.\n";
     infoMsg += "QUIT: quit QBasic immediately.";
 
     info(infoMsg);
 }
 
-void MainWindow::parseAndPrint() {
-    int len = rawStatements.size();
-    for (int i = 0; i < len; ++i) {
-        auto rawStmt = rawStatements[i];
-        try {
-            auto tokens = lexer->scan(rawStmt->srcCode);
-            // Parse stmt.
-            auto stmt = parser->parse(rawStmt->lineno, rawStmt->srcCode, tokens);
-
-            stmt->checkValidation(this);
+void MainWindow::print(const std::string &str) {
+    post(Event{Event::LINE, 0, 0, str});
+}
 
-            // Print the syntax tree of the stmt.
-            std::string str;
-            stmt->print(str);
-            ui->treeDisplay->append(QString::fromStdString(str));
+void MainWindow::flushOutput() {
+    auto batch = outputSink.take();
+    if (batch.dropped > 0)
+        ui->resultBrowser->append(QString::fromStdString("... " + std::to_string(batch.dropped) + " lines skipped"));
+    if (batch.lines > 0)
+        ui->resultBrowser->append(QString::fromStdString(batch.text));
+}
 
-            // Add stmt.
-            statements.push_back(stmt);
+void MainWindow::parseError(int index, int lineno, const std::string &errorMsg) {
+    std::cerr << errorMsg << std::endl;
+    post(Event{Event::PARSE_ERROR, index, lineno, errorMsg});
+}
 
-        } catch (const std::string &errorMsg) {
-            std::cerr << errorMsg << std::endl;
-        }
-        catch (std::exception e) {
-            std::cerr << e.what() << std::endl;
-        } catch (const char *errorMsg) {
-            std::cerr << errorMsg << std::endl;
-            error(errorMsg);
-            ui->treeDisplay->append(QString::number(rawStmt->lineno).append(" Error\n"));
-            highlight(i, Qt::gray);
-            // If invalid, add nullptr.
-            statements.push_back(nullptr);
-        }
-    }
+void MainWindow::runtimeError(int index, int lineno, const std::string &errorMsg) {
+    std::cerr << errorMsg << std::endl;
+    post(Event{Event::RUNTIME_ERROR, index, lineno, errorMsg});
 }
 
 void MainWindow::run() {
+    // The value comes first. A paused run is not busy here, RUN goes on with it.
+    if ((running && busy()) || runningState == INPUT) return;
     lastRunningState = runningState;
     runningState = RUNNING;
-    if (lastRunningState != INPUT) {
+    bool restart = lastRunningState != PAUSED;
+    if (restart)
         init();
-        parseAndPrint();
-    }
 
-    int len = statements.size();
-    int curIdx;
-    for (; stmtIdx < len;) {
-        auto stmt = statements[stmtIdx];
-        curIdx = stmtIdx;
-        try {
-            ++stmtIdx;
+    hand(Job{restart ? Job::START : Job::RESUME});
+}
 
-            // stmt == nullptr means it's invalid.
-            if (stmt == nullptr) continue;
+void MainWindow::stop() {
+    if (running) {
+        request = STOP;
+    } else if (runningState == PAUSED) {
+        lastRunningState = runningState;
+        runningState = END;
+    }
+}
 
-            // Run the stmt.
-            stmt->run(this, ui->resultBrowser);
+void MainWindow::pause() {
+    if (running)
+        request = PAUSE;
+}
 
-            // Special judge, if input, then break, until input complete.
-            if (typeid(*stmt) == typeid(statement::InputStatement))
-                break;
-        } catch (const std::string &errorMsg) {
-            std::cerr << errorMsg << std::endl;
+void MainWindow::hand(Job &&next) {
+    running = true;
+    request = GO;
+    {
+        std::lock_guard <std::mutex> lock(jobMtx);
+        job = std::move(next);
+    }
+    jobCv.notify_one();
+}
+
+void MainWindow::serve() {
+    for (;;) {
+        Job next;
+        {
+            std::unique_lock <std::mutex> lock(jobMtx);
+            jobCv.wait(lock, [this]() { return job.kind != Job::NONE; });
+            next = std::move(job);
+            job = Job();
         }
-        catch (std::exception e) {
-            std::cerr << e.what() << std::endl;
-        } catch (const char *errorMsg) {
-            std::cerr << errorMsg << std::endl;
-            error(errorMsg);
-            highlight(curIdx, QColor(240, 128, 128));
+        switch (next.kind) {
+            case Job::QUIT:
+                return;
+            case Job::START:
+                interpreter->parse();
+                post(Event{Event::PARSED});
+                break;
+            case Job::FEED:
+                interpreter->feed(next.value);
+                break;
+            default:
+                break;
         }
+        work();
     }
+}
 
-    if (stmtIdx == len) {
-        lastRunningState = RUNNING;
-        runningState = END;
+void MainWindow::work() {
+    bool waiting = false;
+    while (request == GO && !interpreter->isFinished() && !waiting) {
+        interpreter->run(SLICE);
+        waiting = interpreter->isSuspended();
     }
+
+    if (interpreter->isFinished() || request == STOP)
+        post(Event{Event::FINISHED});
+    else if (waiting)
+        post(Event{Event::NEEDS_INPUT, 0, 0, pendingInput});
+    else
+        post(Event{Event::PAUSED});
 }
 
-void MainWindow::refreshCode() {
-    std::string code;
-    for (auto rawStmt: rawStatements) {
-        code.append(rawStmt->toString() + "\n");
+bool MainWindow::busy() {
+    if (running) {
+        warning("The code is running, STOP or PAUSE it first!");
+        return true;
     }
-    ui->codeDisplay->setText(QString::fromStdString(code));
+    // A paused run goes on with the statements and the types as parsed.
+    if (runningState == PAUSED) {
+        warning("The code is paused, RUN or STOP it first!");
+        return true;
+    }
+    return false;
 }
 
-void MainWindow::clear() {
-    for (auto rawStmt: rawStatements) {
-        delete rawStmt;
+void MainWindow::post(Event &&event) {
+    // Full, wait for the next frame to take some, unless there is none to come.
+    while (!events.push(std::move(event))) {
+        if (closing) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
-    rawStatements.clear();
-    for (auto stmt: statements) {
-        if (stmt) delete stmt;
+}
+
+void MainWindow::pollEvents() {
+    // A dialog shown below runs the event loop, and with it the frame timer.
+    if (polling) return;
+    polling = true;
+
+    // At most a queue full, so a frame ends even if the worker keeps up.
+    Event event;
+    for (size_t left = events.getCapacity(); left > 0 && events.pop(event); --left) {
+        switch (event.kind) {
+            case Event::LINE:
+                outputSink.write(event.text);
+                break;
+            case Event::PARSED:
+                treeModel->attach();
+                break;
+            case Event::MESSAGE:
+                flushOutput();
+                warning(event.text);
+                break;
+            case Event::PARSE_ERROR:
+                warning(event.text);
+                highlight(event.index, Qt::gray);
+                break;
+            case Event::RUNTIME_ERROR:
+                // The output so far comes before the error.
+                flushOutput();
+                warning(event.text);
+                highlight(event.index, QColor(240, 128, 128));
+                break;
+            case Event::NEEDS_INPUT:
+                running = false;
+                flushOutput();
+                requestInput(event.text);
+                break;
+            case Event::PAUSED:
+                running = false;
+                lastRunningState = runningState;
+                runningState = PAUSED;
+                break;
+            case Event::FINISHED:
+                running = false;
+                lastRunningState = RUNNING;
+                runningState = END;
+                break;
+        }
     }
-    statements.clear();
 
-    ui->codeDisplay->clear();
-    ui->treeDisplay->clear();
+    flushOutput();
+    polling = false;
+}
+
+void MainWindow::clear() {
+    if (busy()) return;
+    treeModel->detach();
+    codeModel->clear();
+
+    outputSink.clear();
     ui->resultBrowser->clear();
     ui->cmdLineEdit->clear();
 
-    tenv->clear();
-    venv->clear();
-
     lastRunningState = runningState;
     runningState = END;
 }
 
 void MainWindow::highlight(int index, QColor color) {
-    QTextCursor cursor = ui->codeDisplay->textCursor();
-    cursor.movePosition(QTextCursor::Start, QTextCursor::MoveAnchor);
-    for (int i = 0; i < index; ++i) {
-        cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::MoveAnchor);
-        cursor.setPosition(cursor.position() + 1, QTextCursor::MoveAnchor);
-    }
-    cursor.movePosition(QTextCursor::EndOfLine, QTextCursor::KeepAnchor);
-    QTextCharFormat charFormat;
-    charFormat.setBackground(color);
-    cursor.setCharFormat(charFormat);
-    cursor.clearSelection();
-}
-
-void MainWindow::gotoLine(int lineno) {
-    int len = statements.size();
-    for (int i = 0; i < len; ++i) {
-        if (statements[i] && statements[i]->getLineno() == lineno) {
-            stmtIdx = i;
-            return;
-        }
-    }
-    throw "Use non-existent line number!";
+    // Statements are in line order, one per line.
+    codeModel->mark(index, color);
 }
 
 void MainWindow::deleteLine(int lineno) {
-    for (auto tmpIter = rawStatements.begin(); tmpIter != rawStatements.end(); ++tmpIter) {
-        if ((*tmpIter)->lineno == lineno) {
-            rawStatements.erase(tmpIter);
-            refreshCode();
-            return;
-        }
-    }
-    throw "Use non-existent line number!";
+    if (busy()) return;
+    // The trees shown are of the program before the edit.
+    treeModel->detach();
+    codeModel->deleteLine(lineno);
 }
 
 void MainWindow::load() {
+    if (busy()) return;
     static std::string lastLoadedDir = "./";
     std::string fileName = QFileDialog::getOpenFileName(this, "Open text file", QString::fromStdString(lastLoadedDir),
                                                         "Text Files(*.txt);;").toStdString();
@@ -303,28 +340,7 @@ void MainWindow::load() {
 
     clear();
 
-    std::ifstream file(fileName);
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line.empty()) continue;
-        try {
-            RawStatement *rawStmt = RawStatement::fromCmdline(line);
-            addRawStatement(rawStmt);
-        }
-        catch (std::exception e) {
-            std::cerr << e.what() << std::endl;
-        } catch (const char *errorMsg) {
-            std::cerr << errorMsg << std::endl;
-            error(errorMsg);
-        }
-        if (file.eof()) break;
-    }
-    refreshCode();
-    file.close();
-}
-
-void MainWindow::end() {
-    stmtIdx = statements.size();
+    codeModel->load(fileName);
 }
 
 void MainWindow::keyPressEvent(QKeyEvent *event) {
@@ -335,14 +351,14 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
             if (cmdline.size() == 0) return;
 
             if (runningState == INPUT) {
-                inputValue = StringUtils::getAfter(cmdline, "? ");
-                inputCv.notify_all();
-                inputWorker->join();
-                delete inputWorker;
-                inputWorker = nullptr;
+                std::string value = StringUtils::getAfter(cmdline, "? ");
                 if (lastRunningState == RUNNING) {
-                    run();
+                    // The program goes on right after its INPUT.
+                    lastRunningState = INPUT;
+                    runningState = RUNNING;
+                    hand(Job{Job::FEED, value});
                 } else {
+                    interpreter->setInput(inputVar, value);
                     runningState = lastRunningState;
                 }
                 goto clear;
@@ -353,18 +369,20 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
                     runBuiltinCmd(cmdline);
                     goto clear;
                 }
-                RawStatement *rawStmt = RawStatement::fromCmdline(cmdline);
-                addRawStatement(rawStmt);
-                refreshCode();
+                if (busy())
+                    goto clear;
+                auto line = RawStatement::fromCmdline(cmdline);
+                treeModel->detach();
+                codeModel->setLine(std::move(line));
             }
             catch (const std::string &errorMsg) {
                 std::cerr << errorMsg << std::endl;
             }
-            catch (std::exception e) {
+            catch (const std::exception &e) {
                 std::cerr << e.what() << std::endl;
             } catch (const char *errorMsg) {
                 std::cerr << errorMsg << std::endl;
-                error(errorMsg);
+                warning(errorMsg);
             }
             clear:
             ui->cmdLineEdit->clear();
@@ -373,42 +391,24 @@ void MainWindow::keyPressEvent(QKeyEvent *event) {
     }
 }
 
-void MainWindow::print(const std::string &cmdline) {
-    auto tokens = lexer->scan(cmdline);
-    auto stmt = parser->parse(0, cmdline, tokens);
-    stmt->run(this, ui->resultBrowser);
+bool MainWindow::input(const std::string &var) {
+    // The run is suspended, the worker asks for it with the last event of the job, then is handed it
+    // with the next one.
+    pendingInput = var;
+    return false;
 }
 
-void MainWindow::inputInBackGround(const std::string &var) {
-    static std::regex intFmt("([1-9][0-9]*)|0");
-    static std::regex strFmt("\".*\"");
-    std::unique_lock <std::mutex> lock(mtx);
-    inputCv.wait(lock);
-
-    if (std::regex_match(inputValue, intFmt)) {
-        tenv->enter(var, env::INT);
-        venv->enter(var, env::Value(std::atoi(inputValue.c_str())));
-    } else if (std::regex_match(inputValue, strFmt)) {
-        tenv->enter(var, env::STRING);
-        venv->enter(var, env::Value(inputValue.substr(1, inputValue.size() - 2)));
-    }
-    inputValue.clear();
-}
-
-void MainWindow::input(const std::string &var) {
-    {
-        std::lock_guard <std::mutex> lock(mtx);
-        if (runningState == INPUT) return;
-        lastRunningState = runningState;
-        runningState = INPUT;
-    }
+void MainWindow::requestInput(const std::string &var) {
+    if (runningState == INPUT) return;
+    lastRunningState = runningState;
+    runningState = INPUT;
+    inputVar = var;
     ui->cmdLineEdit->setText("? ");
-    inputWorker = new std::thread(&MainWindow::inputInBackGround, this, var);
 }
 
 bool MainWindow::isBuiltinCmd(const std::string &cmdline) const {
     static std::regex pattern(
-            "([1-9][0-9]*)|LIST|RUN|LOAD|(PRINT .*)|(INPUT [a-zA-Z][a-zA-Z0-9]*)|CLEAR|HELP|QUIT");
+            "([1-9][0-9]*)|LIST|RUN|LOAD|(PRINT .*)|(INPUT [a-zA-Z][a-zA-Z0-9]*)|(OUTPUT( .+)?)|CLEAR|HELP|QUIT|STOP|PAUSE");
     return std::regex_match(cmdline, pattern);
 }
 
@@ -426,18 +426,39 @@ void MainWindow::runBuiltinCmd(const std::string &cmdline) {
         return;
     }
 
+    if (cmdline == "STOP") {
+        stop();
+        return;
+    }
+
+    if (cmdline == "PAUSE") {
+        pause();
+        return;
+    }
+
     if (cmdline == "LOAD") {
         load();
         return;
     }
 
+    // Before PRINT, the file name may contain it.
+    if (cmdline.compare(0, 6, "OUTPUT") == 0) {
+        std::string fileName = StringUtils::getAfter(cmdline, "OUTPUT");
+        if (!outputSink.spillTo(fileName))
+            warning("Can't open " + fileName + "!");
+        return;
+    }
+
     if (StringUtils::startWith(cmdline, "PRINT")) {
-        print(cmdline);
+        if (busy()) return;
+        interpreter->runImmediate(cmdline);
+        pollEvents();
         return;
     }
 
     if (StringUtils::startWith(cmdline, "INPUT")) {
-        input(StringUtils::getAfter(cmdline, "INPUT "));
+        if (busy()) return;
+        requestInput(StringUtils::getAfter(cmdline, "INPUT "));
         return;
     }
 
@@ -3,12 +3,17 @@
 
 #include <QMainWindow>
 #include <QKeyEvent>
+#include <QTimer>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
-#include <vector>
 #include <mutex>
+#include <vector>
 #include <thread>
-#include <condition_variable>
-#include "table.h"
+#include "codemodel.h"
+#include "interpreter.h"
+#include "output.h"
+#include "treemodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -16,28 +21,11 @@ QT_END_NAMESPACE
 
 namespace statement {
     class RawStatement;
-
-    class Statement;
-}
-
-namespace lexer {
-    class Lexer;
-}
-
-namespace parser {
-    class Parser;
-}
-
-namespace syntax {
-    class Exp;
 }
 
 using RawStatement = statement::RawStatement;
-using Statement = statement::Statement;
-using Lexer = lexer::Lexer;
-using Parser = parser::Parser;
 
-class MainWindow : public QMainWindow {
+class MainWindow : public QMainWindow, public interpreter::Console {
     Q_OBJECT
 
 public:
@@ -48,6 +36,7 @@ public:
     enum RunningState {
         INPUT,
         RUNNING,
+        PAUSED,
         END,
         INIT,
         NONE,
@@ -55,69 +44,161 @@ public:
 
     Ui::MainWindow *ui;
 
-    std::unique_ptr <env::Table<std::string, env::Value>> venv;
-    std::unique_ptr <env::Table<std::string, env::ValueType>> tenv;
+    std::unique_ptr <interpreter::Interpreter> interpreter;
+
+    // The program as shown in the code view.
+    CodeModel *codeModel;
+
+    // Syntax trees of the program as last parsed, printed as the tree view shows them.
+    TreeModel *treeModel;
+
+    // What the interpreter tells the window, in order.
+    struct Event {
+        enum Kind {
+            LINE,
+            // The program is parsed, the trees can be shown.
+            PARSED,
+            MESSAGE,
+            PARSE_ERROR,
+            RUNTIME_ERROR,
+            // The last event of a run.
+            NEEDS_INPUT,
+            PAUSED,
+            FINISHED,
+        } kind = LINE;
+        int index = 0;
+        int lineno = 0;
+        std::string text;
+    };
+
+    enum Request {
+        GO,
+        PAUSE,
+        STOP,
+    };
+
+    // What the worker is asked to do next.
+    struct Job {
+        enum Kind {
+            NONE,
+            // Parse the program, then run it.
+            START,
+            // Go on after PAUSE.
+            RESUME,
+            // Feed the value to the INPUT it stopped at, then go on.
+            FEED,
+            QUIT,
+        } kind = NONE;
+        std::string value;
+    };
+
+    // Statements the worker runs between looks at the request.
+    static const int SLICE = 10000;
+
+    // Events queued before the worker waits for the window to take them.
+    static const int EVENTS = 1 << 16;
 
-    std::thread *inputWorker = nullptr;
+    // The program is parsed and run here, the worker is parked between jobs. The window hands it a job,
+    // then leaves the interpreter alone until the last event of the job.
+    std::thread worker;
 
-    std::mutex mtx;
+    std::mutex jobMtx;
 
-    std::string inputValue;
+    std::condition_variable jobCv;
 
-    std::condition_variable inputCv;
+    Job job;
 
-    int stmtIdx;
+    // A job is out.
+    bool running = false;
 
-    std::vector<RawStatement *> rawStatements;
+    std::atomic <Request> request{GO};
 
-    std::vector<Statement *> statements;
+    // Nobody takes the events any more.
+    std::atomic<bool> closing{false};
 
-    std::unique_ptr <Lexer> lexer;
+    // From the worker to the window, taken once per frame.
+    output::Queue <Event> events{EVENTS};
 
-    std::unique_ptr <Parser> parser;
+    // Variable INPUT stopped the worker at.
+    std::string pendingInput;
 
-    void addRawStatement(RawStatement *rawStmt);
+    // Variable being input on the command line.
+    std::string inputVar;
+
+    bool polling = false;
+
+    // Lines of output the result browser keeps.
+    static const int OUTPUT_LINES = 10000;
+
+    // PRINT goes here, the result browser takes it once per frame.
+    output::Sink outputSink{OUTPUT_LINES};
+
+    QTimer *frameTimer;
 
     bool isBuiltinCmd(const std::string &cmdline) const;
 
     void runBuiltinCmd(const std::string &cmdline);
 
-    void refreshCode();
-
     void controlCmdlineInput();
 
-    void gotoLine(int lineno);
-
     void deleteLine(int lineno);
 
     void highlight(int index, QColor color);
 
-    void parseAndPrint();
-
     void load();
 
     void help();
 
+    // Start the program, or go on with it after PAUSE or INPUT.
     void run();
 
+    void stop();
+
+    void pause();
+
+    void hand(Job &&next);
+
+    // Take the jobs until QUIT. On the worker.
+    void serve();
+
+    // Run the program slice by slice until it is over, waits for input or is asked to stop or pause,
+    // then tell the window. On the worker.
+    void work();
+
+    // Refuse to touch the program or the variables while it runs or is paused, true if so.
+    bool busy();
+
+    void post(Event &&event);
+
+    // Handle the events queued since, then show the output.
+    void pollEvents();
+
     void init();
 
     void clear();
 
-    void end();
+    void print(const std::string &str) override;
 
-    void print(const std::string &cmdline);
+    // Append the output written since to the result browser at once.
+    void flushOutput();
 
-    void inputInBackGround(const std::string &cmdline);
+    bool input(const std::string &var) override;
 
-    void input(const std::string &var);
+    // Read the variable on the command line.
+    void requestInput(const std::string &var);
 
     void info(const std::string &infoMsg);
 
-    void error(const std::string &errorMsg);
+    void warning(const std::string &warningMsg);
+
+    void error(const std::string &errorMsg) override;
 
     void error(const char *format, ...);
 
+    void parseError(int index, int lineno, const std::string &errorMsg) override;
+
+    void runtimeError(int index, int lineno, const std::string &errorMsg) override;
+
 protected:
     void keyPressEvent(QKeyEvent *event);
 };
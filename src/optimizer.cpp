@@ -0,0 +1,863 @@
+#include "optimizer.h"
+#include <algorithm>
+#include <climits>
+#include "statement.h"
+
+namespace optimizer {
+    using namespace syntax;
+
+    static std::string listLines(const std::vector<int> &lines) {
+        std::string str = std::to_string(lines.size());
+        for (size_t i = 0; i < lines.size(); ++i)
+            str += (i == 0 ? " (" : ", ") + std::to_string(lines[i]);
+        return lines.empty() ? str : str + ')';
+    }
+
+    std::string Report::toString() const {
+        std::string str;
+        str += "nodes removed: " + std::to_string(nodesRemoved) + '\n';
+        str += "  constants folded: " + std::to_string(constantsFolded) + '\n';
+        str += "  identities removed: " + std::to_string(identitiesRemoved) + '\n';
+        str += "unreachable statements: " + listLines(unreachable) + '\n';
+        str += "dead stores: " + listLines(deadStores) + '\n';
+        str += "hoisted from loops: " + listLines(hoisted) + '\n';
+        str += "reads propagated: " + std::to_string(propagated) + '\n';
+        str += "fused: increments " + std::to_string(incrementsFused) + ", branches " + std::to_string(branchesFused)
+               + ", gotos " + std::to_string(gotosFused) + '\n';
+        str += "unchecked: reads " + std::to_string(intReads) + ", operations " + std::to_string(intOperations)
+               + '\n';
+        return str;
+    }
+
+    class Counter : public Visitor<Counter> {
+    public:
+        Counter(Arena &arena) : Visitor(arena) {}
+
+        int count = 0;
+
+        void visitChildren(Node &node) {
+            ++count;
+            Visitor::visitChildren(node);
+        }
+    };
+
+    int countNodes(Arena &arena, NodeId root) {
+        Counter counter(arena);
+        counter.visit(root);
+        return counter.count;
+    }
+
+    NodeId Folder::foldTree(NodeId root) {
+        int before = countNodes(arena, root);
+        root = fold(root);
+        report.nodesRemoved += before - countNodes(arena, root);
+        return root;
+    }
+
+    NodeId Folder::fold(NodeId id) {
+        // Children are folded first, and folding may add nodes, so nodes are accessed by id only.
+        switch (arena[id].kind) {
+            case ARITHMETIC_EXP:
+                return foldArithmetic(id);
+            case LOGICAL_EXP:
+                return foldLogical(id);
+            case PRINT_EXP:
+            case IF_THEN_EXP: {
+                NodeId left = fold(arena[id].left);
+                arena[id].left = left;
+                return id;
+            }
+            case LET_EXP: {
+                NodeId right = fold(arena[id].right);
+                arena[id].right = right;
+                return id;
+            }
+            default:
+                return id;
+        }
+    }
+
+    void Folder::toInt(NodeId id, int value) {
+        Node &node = arena[id];
+        node.kind = INT_EXP;
+        node.op = 0;
+        node.left = node.right = NO_NODE;
+        node.value = value;
+        ++report.constantsFolded;
+    }
+
+    NodeId Folder::foldArithmetic(NodeId id) {
+        NodeId left = fold(arena[id].left);
+        NodeId right = fold(arena[id].right);
+        arena[id].left = left;
+        arena[id].right = right;
+        auto op = ArithmeticOp(arena[id].op);
+
+        if (arena[left].kind == INT_EXP && arena[right].kind == INT_EXP) {
+            if (!isPlainArithmetic(op, arena[left].value, arena[right].value))
+                return id;
+            try {
+                toInt(id, applyArithmetic(op, arena[left].value, arena[right].value));
+            } catch (const char *errorMsg) {
+                // Leave it to fail at runtime.
+                (void) errorMsg;
+            }
+            return id;
+        }
+
+        // x + 0, x - 0, x * 1, x / 1, x ** 1, 0 + x, 1 * x.
+        bool rightIdentity = (op == PLUS_OP || op == MINUS_OP) ? isConst(right, 0) : isConst(right, 1);
+        if (rightIdentity && isInt(left)) {
+            ++report.identitiesRemoved;
+            return left;
+        }
+        bool leftIdentity = (op == PLUS_OP && isConst(left, 0)) || (op == TIMES_OP && isConst(left, 1));
+        if (leftIdentity && isInt(right)) {
+            ++report.identitiesRemoved;
+            return right;
+        }
+        return id;
+    }
+
+    NodeId Folder::foldLogical(NodeId id) {
+        NodeId left = fold(arena[id].left);
+        NodeId right = fold(arena[id].right);
+        arena[id].left = left;
+        arena[id].right = right;
+
+        if (arena[left].kind == INT_EXP && arena[right].kind == INT_EXP)
+            toInt(id, applyLogical(LogicOp(arena[id].op), arena[left].value, arena[right].value));
+        return id;
+    }
+
+    int Cfg::successors(const Arena &arena, const std::vector<statement::Statement *> &statements, int index,
+                        int out[2]) {
+        int next = index + 1;
+        if (statements[index] == nullptr) {
+            out[0] = next;
+            return 1;
+        }
+        const Node &node = arena[statements[index]->getSyntaxTree()->getRoot()];
+        switch (node.kind) {
+            case END_EXP:
+                return 0;
+            case GOTO_EXP:
+                out[0] = node.value >= 0 ? node.value : next;
+                return 1;
+            case LET_EXP:
+            case INC_EXP:
+                out[0] = node.op ? node.value : next;
+                return 1;
+            case IF_THEN_EXP:
+            case BRANCH_EXP: {
+                const Node &test = arena[node.left];
+                if (node.value < 0 || (test.kind == INT_EXP && test.value != 1)) {
+                    out[0] = next;
+                    return 1;
+                }
+                if (test.kind == INT_EXP) {
+                    out[0] = node.value;
+                    return 1;
+                }
+                out[0] = next;
+                out[1] = node.value;
+                return 2;
+            }
+            default:
+                out[0] = next;
+                return 1;
+        }
+    }
+
+    Cfg::Cfg(const Arena &arena, const std::vector<statement::Statement *> &statements) {
+        int len = statements.size();
+        blockOf.assign(len, -1);
+        if (len == 0) return;
+
+        // Blocks start at the entry, at jump targets, and after anything but a plain statement.
+        std::vector<bool> leader(len + 1, false);
+        leader[0] = true;
+        int out[2];
+        for (int i = 0; i < len; ++i) {
+            int count = successors(arena, statements, i, out);
+            for (int k = 0; k < count; ++k)
+                leader[out[k]] = true;
+            if (count != 1 || out[0] != i + 1)
+                leader[i + 1] = true;
+        }
+        for (int i = 0; i < len; ++i) {
+            if (leader[i])
+                blocks.push_back(Block{i, i, {}, {}, false});
+            blockOf[i] = blocks.size() - 1;
+            blocks.back().last = i;
+        }
+
+        for (int b = 0; b < int(blocks.size()); ++b) {
+            int count = successors(arena, statements, blocks[b].last, out);
+            for (int k = 0; k < count; ++k) {
+                if (out[k] >= len) {
+                    blocks[b].exits = true;
+                    continue;
+                }
+                int succ = blockOf[out[k]];
+                if (std::find(blocks[b].succs.begin(), blocks[b].succs.end(), succ) == blocks[b].succs.end()) {
+                    blocks[b].succs.push_back(succ);
+                    blocks[succ].preds.push_back(b);
+                }
+            }
+        }
+
+        // Reverse post-order of a depth-first search from the entry.
+        std::vector<bool> seen(blocks.size(), false);
+        std::vector <std::pair<int, int>> stack{{0, 0}};
+        seen[0] = true;
+        while (!stack.empty()) {
+            int b = stack.back().first;
+            if (stack.back().second < int(blocks[b].succs.size())) {
+                int succ = blocks[b].succs[stack.back().second++];
+                if (!seen[succ]) {
+                    seen[succ] = true;
+                    stack.emplace_back(succ, 0);
+                }
+            } else {
+                order.push_back(b);
+                stack.pop_back();
+            }
+        }
+        std::reverse(order.begin(), order.end());
+
+        // Dominators, as in Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+        std::vector<int> rank(blocks.size(), -1);
+        for (int k = 0; k < int(order.size()); ++k)
+            rank[order[k]] = k;
+        idom.assign(blocks.size(), -1);
+        idom[0] = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int k = 1; k < int(order.size()); ++k) {
+                int b = order[k];
+                int dom = -1;
+                for (int pred: blocks[b].preds) {
+                    if (idom[pred] < 0) continue;
+                    if (dom < 0) {
+                        dom = pred;
+                        continue;
+                    }
+                    int other = pred;
+                    while (dom != other) {
+                        while (rank[dom] > rank[other]) dom = idom[dom];
+                        while (rank[other] > rank[dom]) other = idom[other];
+                    }
+                }
+                if (dom != idom[b]) {
+                    idom[b] = dom;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    bool Cfg::dominates(int a, int b) const {
+        while (b != a && b != 0)
+            b = idom[b];
+        return b == a;
+    }
+
+    std::vector<bool> Cfg::loopOf(int header) const {
+        std::vector<int> work;
+        for (int pred: blocks[header].preds) {
+            if (reachable(pred) && dominates(header, pred))
+                work.push_back(pred);
+        }
+        if (work.empty()) return {};
+
+        std::vector<bool> loop(blocks.size(), false);
+        loop[header] = true;
+        while (!work.empty()) {
+            int b = work.back();
+            work.pop_back();
+            if (loop[b]) continue;
+            loop[b] = true;
+            for (int pred: blocks[b].preds) {
+                if (reachable(pred) && !loop[pred])
+                    work.push_back(pred);
+            }
+        }
+        return loop;
+    }
+
+    GlobalOptimizer::GlobalOptimizer(Arena &arena, std::vector<statement::Statement *> &statements, int slotCount,
+                                     Report &report)
+            : arena(arena), statements(statements), slotCount(slotCount), report(report), folder(arena, report) {}
+
+    // The analyses keep a set of variables per block, they are skipped for larger programs.
+    static const size_t MAX_FACTS = 1 << 22;
+
+    void GlobalOptimizer::run() {
+        for (int round = 0; round < 4; ++round) {
+            Cfg cfg(arena, statements);
+            if (cfg.blocks.size() * size_t(slotCount) > MAX_FACTS) return;
+
+            bool changed = removeUnreachable(cfg);
+            analyzeInts(cfg);
+            changed = propagate(cfg) || changed;
+            analyzeInts(cfg);
+            changed = removeDeadStores(cfg) || changed;
+            if (!changed) break;
+        }
+
+        for (int round = 0; round < 16; ++round) {
+            Cfg cfg(arena, statements);
+            analyzeInts(cfg);
+            if (!hoist(cfg)) break;
+        }
+    }
+
+    void GlobalOptimizer::inferTypes() {
+        Cfg cfg(arena, statements);
+        if (cfg.blocks.size() * size_t(slotCount) > MAX_FACTS) return;
+
+        analyzeInts(cfg);
+        for (int b: cfg.order) {
+            std::vector<bool> ints = intsIn(cfg, b);
+            for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i) {
+                if (statements[i])
+                    typeStatement(root(i), ints);
+                stepInts(i, ints);
+            }
+        }
+    }
+
+    NodeId GlobalOptimizer::root(int index) const {
+        return statements[index]->getSyntaxTree()->getRoot();
+    }
+
+    void GlobalOptimizer::remove(int index, std::vector<int> &lines) {
+        lines.push_back(statements[index]->getLineno());
+        delete statements[index];
+        statements[index] = nullptr;
+    }
+
+    bool GlobalOptimizer::removeUnreachable(const Cfg &cfg) {
+        bool changed = false;
+        for (int b = 0; b < int(cfg.blocks.size()); ++b) {
+            if (cfg.reachable(b)) continue;
+            for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i) {
+                if (statements[i]) {
+                    remove(i, report.unreachable);
+                    changed = true;
+                }
+            }
+        }
+        return changed;
+    }
+
+    void GlobalOptimizer::analyzeInts(const Cfg &cfg) {
+        intsOut.assign(cfg.blocks.size(), std::vector<bool>(slotCount, true));
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b: cfg.order) {
+                std::vector<bool> ints = intsIn(cfg, b);
+                for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i)
+                    stepInts(i, ints);
+                if (ints != intsOut[b]) {
+                    intsOut[b] = std::move(ints);
+                    changed = true;
+                }
+            }
+        }
+
+        safe.assign(statements.size(), false);
+        for (int b: cfg.order) {
+            std::vector<bool> ints = intsIn(cfg, b);
+            for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i) {
+                if (statements[i] && arena[root(i)].kind == LET_EXP)
+                    safe[i] = !canFail(arena[root(i)].right, ints);
+                stepInts(i, ints);
+            }
+        }
+    }
+
+    std::vector<bool> GlobalOptimizer::intsIn(const Cfg &cfg, int block) const {
+        // Nothing is defined when the program starts.
+        if (block == 0)
+            return std::vector<bool>(slotCount, false);
+        std::vector<bool> ints(slotCount, true);
+        for (int pred: cfg.blocks[block].preds) {
+            if (!cfg.reachable(pred)) continue;
+            for (int slot = 0; slot < slotCount; ++slot)
+                ints[slot] = ints[slot] && intsOut[pred][slot];
+        }
+        return ints;
+    }
+
+    void GlobalOptimizer::stepInts(int index, std::vector<bool> &ints) const {
+        if (statements[index] == nullptr) return;
+        const Node &node = arena[root(index)];
+        if (node.kind == LET_EXP) {
+            int slot = arena[node.left].value;
+            if (arena[node.right].kind == STRING_EXP)
+                ints[slot] = false;
+            else if (!canFail(node.right, ints))
+                ints[slot] = true;
+        } else if (node.kind == INPUT_EXP) {
+            // The only source of strings besides literals, an invalid input leaves the variable as it is.
+            ints[arena[node.left].value] = false;
+        }
+    }
+
+    bool GlobalOptimizer::canFail(NodeId exp, const std::vector<bool> &ints) const {
+        const Node &node = arena[exp];
+        switch (node.kind) {
+            case INT_EXP:
+            case STRING_EXP:
+                return false;
+            case VAR_EXP:
+                return !ints[node.value];
+            case ARITHMETIC_EXP: {
+                if (canFail(node.left, ints) || canFail(node.right, ints))
+                    return true;
+                const Node &left = arena[node.left];
+                const Node &right = arena[node.right];
+                if (node.op == DIVIDE_OP)
+                    return !(right.kind == INT_EXP && right.value != 0);
+                if (node.op == INDEX_OP)
+                    return !((left.kind == INT_EXP && left.value != 0) || (right.kind == INT_EXP && right.value > 0));
+                return false;
+            }
+            default:
+                return true;
+        }
+    }
+
+    bool GlobalOptimizer::propagate(const Cfg &cfg) {
+        factsOut.assign(cfg.blocks.size(), std::vector<Fact>(slotCount, Fact{Fact::UNKNOWN, 0, NO_NODE}));
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b: cfg.order) {
+                std::vector<Fact> facts = factsIn(cfg, b);
+                std::vector<bool> ints = intsIn(cfg, b);
+                for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i) {
+                    stepFacts(i, facts, ints);
+                    stepInts(i, ints);
+                }
+                if (facts != factsOut[b]) {
+                    factsOut[b] = std::move(facts);
+                    changed = true;
+                }
+            }
+        }
+
+        int propagated = 0;
+        for (int b: cfg.order) {
+            std::vector<Fact> facts = factsIn(cfg, b);
+            std::vector<bool> ints = intsIn(cfg, b);
+            for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i) {
+                if (statements[i]) {
+                    Node &node = arena[root(i)];
+                    int count = 0;
+                    if (node.kind == PRINT_EXP || node.kind == IF_THEN_EXP)
+                        count = substitute(node.left, facts);
+                    else if (node.kind == LET_EXP)
+                        count = substitute(node.right, facts);
+                    if (count > 0) {
+                        statements[i]->fold(&folder);
+                        propagated += count;
+                    }
+                }
+                stepFacts(i, facts, ints);
+                stepInts(i, ints);
+            }
+        }
+        report.propagated += propagated;
+        return propagated > 0;
+    }
+
+    std::vector<GlobalOptimizer::Fact> GlobalOptimizer::factsIn(const Cfg &cfg, int block) const {
+        if (block == 0)
+            return std::vector<Fact>(slotCount, Fact{Fact::VARYING, 0, NO_NODE});
+        std::vector<Fact> facts(slotCount, Fact{Fact::UNKNOWN, 0, NO_NODE});
+        for (int pred: cfg.blocks[block].preds) {
+            if (!cfg.reachable(pred)) continue;
+            for (int slot = 0; slot < slotCount; ++slot) {
+                Fact &fact = facts[slot];
+                const Fact &other = factsOut[pred][slot];
+                if (fact.kind == Fact::UNKNOWN)
+                    fact = other;
+                else if (other.kind != Fact::UNKNOWN && !(fact == other))
+                    fact = Fact{Fact::VARYING, 0, NO_NODE};
+            }
+        }
+        return facts;
+    }
+
+    void GlobalOptimizer::stepFacts(int index, std::vector<Fact> &facts, const std::vector<bool> &ints) const {
+        if (statements[index] == nullptr) return;
+        const Node &node = arena[root(index)];
+        if (node.kind == LET_EXP) {
+            int slot = arena[node.left].value;
+            Fact fact{Fact::VARYING, 0, NO_NODE};
+            int value;
+            NodeId var;
+            // Unknown until what it reads is known, or the facts could go up and down and never settle.
+            if (readsUnknown(node.right, facts))
+                fact = Fact{Fact::UNKNOWN, 0, NO_NODE};
+            else if (evalConst(node.right, facts, value))
+                fact = Fact{Fact::CONST, value, NO_NODE};
+            else if ((var = copyOf(node.right, ints)) != NO_NODE && arena[var].value != slot)
+                fact = Fact{Fact::COPY, arena[var].value, var};
+
+            kill(slot, facts);
+            facts[slot] = fact;
+        } else if (node.kind == INPUT_EXP) {
+            int slot = arena[node.left].value;
+            kill(slot, facts);
+            facts[slot] = Fact{Fact::VARYING, 0, NO_NODE};
+        }
+    }
+
+    void GlobalOptimizer::kill(int slot, std::vector<Fact> &facts) const {
+        for (Fact &fact: facts) {
+            if (fact.kind == Fact::COPY && fact.value == slot)
+                fact = Fact{Fact::VARYING, 0, NO_NODE};
+        }
+    }
+
+    bool GlobalOptimizer::evalConst(NodeId exp, const std::vector<Fact> &facts, int &value) const {
+        const Node &node = arena[exp];
+        switch (node.kind) {
+            case INT_EXP:
+                value = node.value;
+                return true;
+            case VAR_EXP:
+                value = facts[node.value].value;
+                return facts[node.value].kind == Fact::CONST;
+            case ARITHMETIC_EXP: {
+                int left, right;
+                if (!evalConst(node.left, facts, left) || !evalConst(node.right, facts, right))
+                    return false;
+                // A trap or an overflow is no constant, it happens at run time if at all.
+                if (!isPlainArithmetic(ArithmeticOp(node.op), left, right))
+                    return false;
+                try {
+                    value = applyArithmetic(ArithmeticOp(node.op), left, right);
+                    return true;
+                } catch (const char *errorMsg) {
+                    (void) errorMsg;
+                    return false;
+                }
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool GlobalOptimizer::readsUnknown(NodeId exp, const std::vector<Fact> &facts) const {
+        const Node &node = arena[exp];
+        if (node.kind == VAR_EXP)
+            return facts[node.value].kind == Fact::UNKNOWN;
+        if (node.kind == ARITHMETIC_EXP)
+            return readsUnknown(node.left, facts) || readsUnknown(node.right, facts);
+        return false;
+    }
+
+    NodeId GlobalOptimizer::copyOf(NodeId exp, const std::vector<bool> &ints) const {
+        const Node &node = arena[exp];
+        if (node.kind != ARITHMETIC_EXP) return NO_NODE;
+        const Node &left = arena[node.left];
+        const Node &right = arena[node.right];
+        auto isConst = [](const Node &val, int value) { return val.kind == INT_EXP && val.value == value; };
+
+        bool rightIdentity = (node.op == PLUS_OP || node.op == MINUS_OP) ? isConst(right, 0) : isConst(right, 1);
+        if (rightIdentity && left.kind == VAR_EXP && ints[left.value])
+            return node.left;
+        bool leftIdentity = (node.op == PLUS_OP && isConst(left, 0)) || (node.op == TIMES_OP && isConst(left, 1));
+        if (leftIdentity && right.kind == VAR_EXP && ints[right.value])
+            return node.right;
+        return NO_NODE;
+    }
+
+    int GlobalOptimizer::substitute(NodeId exp, const std::vector<Fact> &facts) {
+        Node &node = arena[exp];
+        if (node.kind == VAR_EXP) {
+            const Fact &fact = facts[node.value];
+            if (fact.kind == Fact::CONST) {
+                node.kind = INT_EXP;
+                node.value = fact.value;
+                return 1;
+            }
+            if (fact.kind == Fact::COPY) {
+                node.value = fact.value;
+                node.str = arena[fact.var].str;
+                return 1;
+            }
+            return 0;
+        }
+        int count = 0;
+        if (node.kind == ARITHMETIC_EXP || node.kind == LOGICAL_EXP) {
+            count += substitute(node.left, facts);
+            count += substitute(arena[exp].right, facts);
+        }
+        return count;
+    }
+
+    bool GlobalOptimizer::removeDeadStores(const Cfg &cfg) {
+        // Every variable may be printed once the program is over.
+        liveIn.assign(cfg.blocks.size(), std::vector<bool>(slotCount, false));
+        auto liveOut = [&](int b) {
+            std::vector<bool> live(slotCount, cfg.blocks[b].exits);
+            for (int succ: cfg.blocks[b].succs) {
+                for (int slot = 0; slot < slotCount; ++slot)
+                    live[slot] = live[slot] || liveIn[succ][slot];
+            }
+            return live;
+        };
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto it = cfg.order.rbegin(); it != cfg.order.rend(); ++it) {
+                std::vector<bool> live = liveOut(*it);
+                for (int i = cfg.blocks[*it].last; i >= cfg.blocks[*it].first; --i)
+                    stepLive(i, live);
+                if (live != liveIn[*it]) {
+                    liveIn[*it] = std::move(live);
+                    changed = true;
+                }
+            }
+        }
+
+        bool removed = false;
+        for (int b: cfg.order) {
+            std::vector<bool> live = liveOut(b);
+            for (int i = cfg.blocks[b].last; i >= cfg.blocks[b].first; --i) {
+                if (!stepLive(i, live)) {
+                    remove(i, report.deadStores);
+                    removed = true;
+                }
+            }
+        }
+        // Listed by line number, they are found backwards.
+        std::sort(report.deadStores.begin(), report.deadStores.end());
+        return removed;
+    }
+
+    bool GlobalOptimizer::stepLive(int index, std::vector<bool> &live) const {
+        if (statements[index] == nullptr) return true;
+        const Node &node = arena[root(index)];
+        switch (node.kind) {
+            case LET_EXP: {
+                int slot = arena[node.left].value;
+                if (safe[index]) {
+                    if (!live[slot]) return false;
+                    live[slot] = false;
+                }
+                markUses(node.right, live);
+                break;
+            }
+            case PRINT_EXP:
+            case IF_THEN_EXP:
+                markUses(node.left, live);
+                break;
+            case END_EXP:
+                live.assign(slotCount, true);
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    void GlobalOptimizer::markUses(NodeId exp, std::vector<bool> &live) const {
+        const Node &node = arena[exp];
+        if (node.kind == VAR_EXP) {
+            live[node.value] = true;
+        } else if (node.kind == ARITHMETIC_EXP || node.kind == LOGICAL_EXP) {
+            markUses(node.left, live);
+            markUses(node.right, live);
+        }
+    }
+
+    void GlobalOptimizer::typeStatement(NodeId id, const std::vector<bool> &ints) {
+        Node &node = arena[id];
+        switch (node.kind) {
+            case PRINT_EXP:
+            case IF_THEN_EXP:
+                typeExp(node.left, ints);
+                break;
+            case LET_EXP:
+                typeExp(node.right, ints);
+                break;
+            case INC_EXP:
+                node.intOnly = ints[arena[node.left].value];
+                report.intOperations += node.intOnly;
+                break;
+            case BRANCH_EXP:
+                node.intOnly = typeExp(node.left, ints);
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool GlobalOptimizer::typeExp(NodeId exp, const std::vector<bool> &ints) {
+        Node &node = arena[exp];
+        switch (node.kind) {
+            case INT_EXP:
+                return true;
+            case VAR_EXP:
+                node.intOnly = ints[node.value];
+                report.intReads += node.intOnly;
+                return node.intOnly;
+            case ARITHMETIC_EXP:
+            case LOGICAL_EXP: {
+                bool left = typeExp(node.left, ints);
+                bool right = typeExp(node.right, ints);
+                node.intOnly = left && right;
+                report.intOperations += node.intOnly;
+                return node.intOnly;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool GlobalOptimizer::hoist(const Cfg &cfg) {
+        int len = statements.size();
+        int out[2];
+        for (int h: cfg.order) {
+            std::vector<bool> loop = cfg.loopOf(h);
+            if (loop.empty()) continue;
+
+            // Assignments in the loop, INPUT included.
+            std::vector<int> defs(slotCount, 0);
+            for (int b = 0; b < int(cfg.blocks.size()); ++b) {
+                if (!loop[b]) continue;
+                for (int i = cfg.blocks[b].first; i <= cfg.blocks[b].last; ++i) {
+                    if (statements[i] == nullptr) continue;
+                    const Node &node = arena[root(i)];
+                    if (node.kind == LET_EXP || node.kind == INPUT_EXP)
+                        ++defs[arena[node.left].value];
+                }
+            }
+
+            // The head of the loop, assignments of values that don't change in the loop.
+            const Cfg::Block &head = cfg.blocks[h];
+            std::vector<bool> invariant(slotCount, false);
+            std::vector<int> lines;
+            int end = head.first;
+            for (int i = head.first; i <= head.last; ++i) {
+                if (statements[i]) {
+                    const Node &node = arena[root(i)];
+                    if (node.kind == LET_EXP) {
+                        int slot = arena[node.left].value;
+                        if (!safe[i] || defs[slot] != 1) break;
+                        std::vector<bool> uses(slotCount, false);
+                        markUses(node.right, uses);
+                        bool usesVarying = false;
+                        for (int use = 0; use < slotCount; ++use)
+                            usesVarying = usesVarying || (uses[use] && defs[use] != 0 && !invariant[use]);
+                        if (usesVarying) break;
+                        invariant[slot] = true;
+                        lines.push_back(statements[i]->getLineno());
+                    } else if (node.kind != REM_EXP) {
+                        break;
+                    }
+                }
+                end = i + 1;
+            }
+            if (lines.empty()) continue;
+
+            // Only jumps can be retargeted, not running into the head.
+            std::vector<NodeId> jumps;
+            bool retargetable = true;
+            for (int pred: head.preds) {
+                if (!loop[pred]) continue;
+                int last = cfg.blocks[pred].last;
+                int count = Cfg::successors(arena, statements, last, out);
+                bool fallthrough = last + 1 == head.first
+                                   && std::find(out, out + count, last + 1) != out + count;
+                const Node *node = statements[last] ? &arena[root(last)] : nullptr;
+                if (fallthrough || node == nullptr || node->value != head.first
+                    || (node->kind != GOTO_EXP && node->kind != IF_THEN_EXP)) {
+                    retargetable = false;
+                    break;
+                }
+                jumps.push_back(root(last));
+            }
+            if (!retargetable || end > len) continue;
+
+            for (NodeId jump: jumps)
+                arena[jump].value = end;
+            report.hoisted.insert(report.hoisted.end(), lines.begin(), lines.end());
+            return true;
+        }
+        return false;
+    }
+
+    void Fuser::run() {
+        int len = statements.size();
+        for (int i = 0; i < len; ++i) {
+            if (statements[i] == nullptr) continue;
+            NodeId root = statements[i]->getSyntaxTree()->getRoot();
+            if (arena[root].kind == LET_EXP)
+                fuseIncrement(root);
+            else if (arena[root].kind == IF_THEN_EXP)
+                fuseBranch(root);
+
+            // A GOTO to a missing line fails on its own line, so it is left as it is.
+            Node &node = arena[root];
+            if ((node.kind == LET_EXP || node.kind == INC_EXP) && i + 1 < len && statements[i + 1]) {
+                const Node &next = arena[statements[i + 1]->getSyntaxTree()->getRoot()];
+                if (next.kind == GOTO_EXP && next.value >= 0) {
+                    node.op = 1;
+                    node.value = next.value;
+                    ++report.gotosFused;
+                }
+            }
+        }
+    }
+
+    void Fuser::fuseIncrement(NodeId id) {
+        Node &node = arena[id];
+        const Node &exp = arena[node.right];
+        if (exp.kind != ARITHMETIC_EXP || (exp.op != PLUS_OP && exp.op != MINUS_OP)) return;
+        int slot = arena[node.left].value;
+        const Node &left = arena[exp.left];
+        const Node &right = arena[exp.right];
+        NodeId increment;
+        if (left.kind == VAR_EXP && left.value == slot && right.kind == INT_EXP) {
+            if (exp.op == PLUS_OP)
+                increment = exp.right;
+            else if (right.value != INT_MIN)
+                increment = arena.intExp(-right.value);
+            else
+                return;
+        } else if (exp.op == PLUS_OP && right.kind == VAR_EXP && right.value == slot && left.kind == INT_EXP) {
+            increment = exp.left;
+        } else {
+            return;
+        }
+        // The arena may have grown.
+        arena[id].kind = INC_EXP;
+        arena[id].right = increment;
+        ++report.incrementsFused;
+    }
+
+    void Fuser::fuseBranch(NodeId id) {
+        Node &test = arena[arena[id].left];
+        if (test.kind != LOGICAL_EXP) return;
+        if (arena[test.left].kind == INT_EXP && arena[test.right].kind == VAR_EXP) {
+            // c op x is x op' c.
+            static const LogicOp swapped[] = {EQ, NEQ, LT, LE, GT, GE};
+            std::swap(test.left, test.right);
+            test.op = swapped[test.op];
+        }
+        if (arena[test.left].kind != VAR_EXP || arena[test.right].kind != INT_EXP) return;
+        arena[id].kind = BRANCH_EXP;
+        ++report.branchesFused;
+    }
+}
@@ -0,0 +1,254 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <string>
+#include <vector>
+#include "syntax.h"
+
+namespace statement {
+    class Statement;
+}
+
+namespace optimizer {
+    // What the optimizer did to a program.
+    class Report {
+    public:
+        // Nodes no longer evaluated, counted with multiplicity.
+        int nodesRemoved = 0;
+
+        int constantsFolded = 0;
+
+        int identitiesRemoved = 0;
+
+        // Line numbers of the statements removed or skipped by the global optimizer.
+        std::vector<int> unreachable;
+
+        std::vector<int> deadStores;
+
+        // Skipped on all but the first iteration of their loop.
+        std::vector<int> hoisted;
+
+        // Variable reads replaced by a constant or by the variable copied.
+        int propagated = 0;
+
+        // Statements turned into their fused forms.
+        int incrementsFused = 0;
+
+        int branchesFused = 0;
+
+        int gotosFused = 0;
+
+        // Variable reads and operations that run without type checks.
+        int intReads = 0;
+
+        int intOperations = 0;
+
+        std::string toString() const;
+    };
+
+    // Fold constant subtrees and drop identities such as x * 1 and x + 0. Runtime errors are kept, e.g. 1 / 0 is
+    // left as it is, and so are an overflow and a variable that may hold a string.
+    class Folder {
+    public:
+        Folder(syntax::Arena &arena, Report &report) : arena(arena), report(report) {}
+
+        // Fold the tree of root, return the new root.
+        syntax::NodeId foldTree(syntax::NodeId root);
+
+    private:
+        syntax::Arena &arena;
+
+        Report &report;
+
+        // Return the node replacing id, which may be id itself.
+        syntax::NodeId fold(syntax::NodeId id);
+
+        syntax::NodeId foldArithmetic(syntax::NodeId id);
+
+        syntax::NodeId foldLogical(syntax::NodeId id);
+
+        // Turn id into a constant.
+        void toInt(syntax::NodeId id, int value);
+
+        // The exp is sure to be int when evaluated without error, so it can replace an arithmetic exp.
+        inline bool isInt(syntax::NodeId id) const {
+            return arena[id].kind == syntax::INT_EXP || arena[id].kind == syntax::ARITHMETIC_EXP;
+        }
+
+        inline bool isConst(syntax::NodeId id, int value) const {
+            return arena[id].kind == syntax::INT_EXP && arena[id].value == value;
+        }
+    };
+
+    // Control flow graph of a program, a block is a run of statements only entered at its first one.
+    // Invalid and removed statements are nullptr, and are just passed through.
+    class Cfg {
+    public:
+        struct Block {
+            // Statements [first, last].
+            int first;
+            int last;
+            std::vector<int> succs;
+            std::vector<int> preds;
+            // May leave the program, by END or by running past the last statement.
+            bool exits = false;
+        };
+
+        Cfg(const syntax::Arena &arena, const std::vector<statement::Statement *> &statements);
+
+        std::vector <Block> blocks;
+
+        // Block of each statement.
+        std::vector<int> blockOf;
+
+        // Reachable blocks in reverse post-order, the entry first.
+        std::vector<int> order;
+
+        // Immediate dominator of each block, -1 if unreachable, the entry is its own.
+        std::vector<int> idom;
+
+        inline bool reachable(int block) const { return idom[block] >= 0; }
+
+        bool dominates(int a, int b) const;
+
+        // Blocks of the natural loop of header, empty if no back edge goes to it.
+        std::vector<bool> loopOf(int header) const;
+
+        // Statements that may run after the index-th one, at most 2, statements.size() stands for leaving
+        // the program. A jump to a missing line fails, and goes on with the next statement.
+        static int successors(const syntax::Arena &arena, const std::vector<statement::Statement *> &statements,
+                              int index, int out[2]);
+    };
+
+    // Optimize a linked program as a whole: remove unreachable statements and dead stores, propagate
+    // constants and copies of int variables, and skip the invariant assignments at the head of a loop on
+    // all but the first iteration. A runtime error only skips its statement, so statements that may fail
+    // are never removed. Removed statements become nullptr, so indices and jump targets stay valid.
+    class GlobalOptimizer {
+    public:
+        GlobalOptimizer(syntax::Arena &arena, std::vector<statement::Statement *> &statements, int slotCount,
+                        Report &report);
+
+        void run();
+
+        // Mark the reads of variables sure to hold an int, and the operations on them, so that they run
+        // without type checks. Fused forms are known, so this may run after the Fuser.
+        void inferTypes();
+
+    private:
+        // What is known about a variable at some point.
+        struct Fact {
+            enum Kind {
+                // Nothing reaches the point yet.
+                UNKNOWN,
+                CONST,
+                // Holds the same int as the variable of slot value, read by the VAR_EXP var.
+                COPY,
+                VARYING,
+            } kind;
+            int value;
+            syntax::NodeId var;
+
+            inline bool operator==(const Fact &other) const {
+                return kind == other.kind && value == other.value;
+            }
+        };
+
+        syntax::Arena &arena;
+
+        std::vector<statement::Statement *> &statements;
+
+        int slotCount;
+
+        Report &report;
+
+        Folder folder;
+
+        // Variables sure to hold an int at the end of each block.
+        std::vector <std::vector<bool>> intsOut;
+
+        // LET statements sure not to fail.
+        std::vector<bool> safe;
+
+        std::vector <std::vector<Fact>> factsOut;
+
+        std::vector <std::vector<bool>> liveIn;
+
+        syntax::NodeId root(int index) const;
+
+        void remove(int index, std::vector<int> &lines);
+
+        bool removeUnreachable(const Cfg &cfg);
+
+        // Variables sure to hold an int, they can't fail arithmetic.
+        void analyzeInts(const Cfg &cfg);
+
+        std::vector<bool> intsIn(const Cfg &cfg, int block) const;
+
+        void stepInts(int index, std::vector<bool> &ints) const;
+
+        bool canFail(syntax::NodeId exp, const std::vector<bool> &ints) const;
+
+        bool propagate(const Cfg &cfg);
+
+        std::vector <Fact> factsIn(const Cfg &cfg, int block) const;
+
+        void stepFacts(int index, std::vector <Fact> &facts, const std::vector<bool> &ints) const;
+
+        // The copies of slot are stale.
+        void kill(int slot, std::vector <Fact> &facts) const;
+
+        bool evalConst(syntax::NodeId exp, const std::vector <Fact> &facts, int &value) const;
+
+        // exp reads a variable that nothing reaches yet.
+        bool readsUnknown(syntax::NodeId exp, const std::vector <Fact> &facts) const;
+
+        // The VAR_EXP of w if exp is w + 0 or alike with w an int, otherwise NO_NODE.
+        syntax::NodeId copyOf(syntax::NodeId exp, const std::vector<bool> &ints) const;
+
+        // Replace the reads of exp by what is known, return how many are replaced.
+        int substitute(syntax::NodeId exp, const std::vector <Fact> &facts);
+
+        bool removeDeadStores(const Cfg &cfg);
+
+        // Step back over the index-th statement, return false if it is a dead store.
+        bool stepLive(int index, std::vector<bool> &live) const;
+
+        void markUses(syntax::NodeId exp, std::vector<bool> &live) const;
+
+        void typeStatement(syntax::NodeId id, const std::vector<bool> &ints);
+
+        // Return true if exp is proven to be an int.
+        bool typeExp(syntax::NodeId exp, const std::vector<bool> &ints);
+
+        // Retarget the back edges of one loop past its invariant head, return false if there is none.
+        bool hoist(const Cfg &cfg);
+    };
+
+    // Turn the statements of common shapes into fused forms that run at once: LET x = x + c into INC_EXP,
+    // IF x op c THEN n into BRANCH_EXP, and a LET followed by a GOTO into a LET that jumps by itself, the
+    // GOTO is kept for the jumps to it. Runs last, the other passes don't know the fused forms.
+    class Fuser {
+    public:
+        Fuser(syntax::Arena &arena, std::vector<statement::Statement *> &statements, Report &report)
+                : arena(arena), statements(statements), report(report) {}
+
+        void run();
+
+    private:
+        syntax::Arena &arena;
+
+        std::vector<statement::Statement *> &statements;
+
+        Report &report;
+
+        void fuseIncrement(syntax::NodeId id);
+
+        void fuseBranch(syntax::NodeId id);
+    };
+
+    // Number of nodes evaluated for the tree, shared subtrees count once per use.
+    int countNodes(syntax::Arena &arena, syntax::NodeId root);
+}
+
+#endif // OPTIMIZER_H
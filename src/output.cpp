@@ -0,0 +1,54 @@
+#include "output.h"
+
+namespace output {
+    Sink::Sink(size_t capacity) : ring(capacity > 0 ? capacity : 1) {}
+
+    void Sink::write(const std::string &line) {
+        std::lock_guard <std::mutex> lock(mtx);
+        if (spill.is_open())
+            spill << line << '\n';
+        // Assigned in place, the string of the line overwritten is reused.
+        ring[head] = line;
+        head = (head + 1) % ring.size();
+        if (pending < ring.size())
+            ++pending;
+        else
+            ++dropped;
+    }
+
+    Sink::Batch Sink::take() {
+        std::lock_guard <std::mutex> lock(mtx);
+        Batch batch;
+        batch.lines = pending;
+        batch.dropped = dropped;
+        size_t size = ring.size();
+        for (size_t i = (head + size - pending) % size; pending > 0; i = (i + 1) % size, --pending) {
+            batch.text += ring[i];
+            if (pending > 1)
+                batch.text += '\n';
+        }
+        dropped = 0;
+        if (spill.is_open())
+            spill.flush();
+        return batch;
+    }
+
+    bool Sink::spillTo(const std::string &path) {
+        std::lock_guard <std::mutex> lock(mtx);
+        if (spill.is_open())
+            spill.close();
+        if (path.empty())
+            return true;
+        spill.open(path);
+        return spill.is_open();
+    }
+
+    void Sink::clear() {
+        std::lock_guard <std::mutex> lock(mtx);
+        head = 0;
+        pending = 0;
+        dropped = 0;
+        if (spill.is_open())
+            spill.flush();
+    }
+}
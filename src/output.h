@@ -0,0 +1,111 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace output {
+    // Bounded queue from one thread to another without locks. Each end only moves its own index and reads the
+    // other one's with acquire, so a slot is handed over whole: the producer fills it before publishing the tail,
+    // the consumer empties it before publishing the head.
+    template<typename T>
+    class Queue {
+    public:
+        // The capacity is rounded up to a power of two.
+        explicit Queue(size_t capacity) : ring(roundUp(capacity)), mask(ring.size() - 1) {}
+
+        // false if full, the value is left as it is.
+        bool push(T &&value) {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+            if (tail - head.load(std::memory_order_acquire) == ring.size())
+                return false;
+            ring[tail & mask] = std::move(value);
+            this->tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // false if empty.
+        bool pop(T &value) {
+            size_t head = this->head.load(std::memory_order_relaxed);
+            if (head == tail.load(std::memory_order_acquire))
+                return false;
+            value = std::move(ring[head & mask]);
+            this->head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        inline size_t getCapacity() const {
+            return ring.size();
+        }
+
+    private:
+        std::vector <T> ring;
+
+        size_t mask;
+
+        // Apart, so the two ends don't write the same cache line.
+        alignas(64) std::atomic <size_t> head{0};
+
+        alignas(64) std::atomic <size_t> tail{0};
+
+        static size_t roundUp(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity)
+                size *= 2;
+            return size;
+        }
+    };
+
+    // Output of PRINT on its way to a view that can't take it line by line. The interpreter writes the lines,
+    // the view takes the ones written since in a batch, e.g. once per frame. Only the last lines up to the
+    // capacity are kept, older ones are dropped and counted. Every line can also be spilled to a file.
+    class Sink {
+    public:
+        // Lines taken at once, oldest first.
+        struct Batch {
+            std::string text;
+            size_t lines = 0;
+            // Lines dropped before these, as they were not taken in time.
+            size_t dropped = 0;
+        };
+
+        explicit Sink(size_t capacity);
+
+        void write(const std::string &line);
+
+        // The lines written since the last take.
+        Batch take();
+
+        // Write every line to the file from now on, false if it can't be opened. An empty path stops it.
+        bool spillTo(const std::string &path);
+
+        // Drop the lines, the spill file is kept.
+        void clear();
+
+        inline size_t getCapacity() const {
+            return ring.size();
+        }
+
+    private:
+        std::mutex mtx;
+
+        std::vector <std::string> ring;
+
+        // Where the next line goes.
+        size_t head = 0;
+
+        // The last pending lines in the ring haven't been taken yet.
+        size_t pending = 0;
+
+        size_t dropped = 0;
+
+        std::ofstream spill;
+    };
+}
+
+#endif // OUTPUT_H
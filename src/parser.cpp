@@ -1,9 +1,8 @@
 #include "parser.h"
 #include "stringutils.h"
-#include <stack>
 
 namespace parser {
-    statement::StatementType Parser::getStatementType(const std::vector <Token> &tokens) const {
+    statement::StatementType Parser::getStatementType(TokenSpan tokens) const {
         if (tokens.empty()) {
             throw "Statement can't be empty!";
         }
@@ -40,128 +39,106 @@ namespace parser {
         throw "Invalid statement!";
     }
 
-    void Parser::computeRPN(const std::vector <Token> &tokens, std::vector <Token> &rpn) const {
-        std::stack <Token> opStack;
-        Token lastToken = Token::makeToken("", INVALID);
-        opStack.push(Token::makeToken("", INVALID));
+    syntax::ArithmeticOp Parser::arithmeticOp(TokenType type) {
+        switch (type) {
+            case PLUS:
+                return syntax::PLUS_OP;
+            case MINUS:
+                return syntax::MINUS_OP;
+            case TIMES:
+                return syntax::TIMES_OP;
+            case DIVIDE:
+                return syntax::DIVIDE_OP;
+            default:
+                return syntax::INDEX_OP;
+        }
+    }
 
-        for (const Token &token:tokens) {
-            TokenType lastType = lastToken.type;
-            lastToken = token;
-            switch (token.type) {
-                case ID:
-                case INT: {
-                    if (lastType == ID || lastType == INT || lastType == RPAREN) {
-                        throw "Invalid exp!";
-                    }
-                    rpn.push_back(token);
-                    break;
-                }
-                case PLUS:
-                case MINUS:
-                case TIMES:
-                case DIVIDE:
-                case INDEX: {
-                    if (lastType != RPAREN && lastType != ID && lastType != INT)
-                        throw "Invalid exp!";
-                    int thisPrior = prior[token.type];
-                    while (thisPrior <= prior[opStack.top().type]) {
-                        rpn.push_back(opStack.top());
-                        opStack.pop();
-                    }
-                    opStack.push(token);
-                    break;
-                }
-                case LPAREN: {
-                    opStack.push(token);
-                    break;
-                }
-                case RPAREN: {
-                    while (opStack.size() > 1 && opStack.top().type != LPAREN) {
-                        rpn.push_back(opStack.top());
-                        opStack.pop();
-                    }
-                    // pop lparen
-                    if (opStack.size() > 1) {
-                        opStack.pop();
-                    } else {
-                        throw "Parenthesis not match!";
-                    }
-                    break;
-                }
-                default:
-                    throw "Invalid exp!";
+    syntax::NodeId Parser::parsePrimary(TokenSpan tokens, size_t &pos) {
+        if (pos >= tokens.size()) return syntax::NO_NODE;
+        const Token &token = tokens[pos++];
+        switch (token.type) {
+            case INT:
+                return arena->intExp(token.value);
+            case ID:
+                return arena->varExp(std::string(token.tok));
+            case LPAREN: {
+                syntax::NodeId exp = parseBinary(tokens, pos, prior(LPAREN) + 1);
+                if (exp == syntax::NO_NODE) return syntax::NO_NODE;
+                if (pos >= tokens.size() || tokens[pos].type != RPAREN)
+                    return syntax::NO_NODE;
+                ++pos;
+                return exp;
             }
+            default:
+                return syntax::NO_NODE;
         }
+    }
 
-        while (opStack.size() > 1) {
-            if (opStack.top().type == LPAREN) throw "Parenthesis not match!";
-            rpn.push_back(opStack.top());
-            opStack.pop();
+    syntax::NodeId Parser::parseBinary(TokenSpan tokens, size_t &pos, int minPrior) {
+        syntax::NodeId left = parsePrimary(tokens, pos);
+        if (left == syntax::NO_NODE) return syntax::NO_NODE;
+
+        while (pos < tokens.size() && isArithmeticOp(tokens[pos].type)) {
+            TokenType type = tokens[pos].type;
+            int thisPrior = prior(type);
+            if (thisPrior < minPrior) break;
+            ++pos;
+            // All the operators are left associative, so the right operand only takes tighter ones.
+            syntax::NodeId right = parseBinary(tokens, pos, thisPrior + 1);
+            if (right == syntax::NO_NODE) return syntax::NO_NODE;
+            left = arena->arithmeticExp(arithmeticOp(type), left, right);
         }
+        return left;
     }
 
-    syntax::Exp *Parser::parseArithmetic(const std::vector <Token> &tokens) const {
-        std::vector <Token> rpn;
-        std::stack < syntax::Exp * > expStack;
-        computeRPN(tokens, rpn);
+    const char *Parser::diagnose(TokenSpan tokens) const {
+        TokenType lastType = INVALID;
+        int depth = 0;
 
-        for (auto token:rpn) {
+        for (const Token &token:tokens) {
+            TokenType type = lastType;
+            lastType = token.type;
             switch (token.type) {
-                case INT: {
-                    expStack.push(new syntax::IntExp(std::atoi(token.tok.c_str())));
-                    break;
-                }
-                case ID: {
-                    expStack.push(new syntax::VarExp(token.tok));
+                case ID:
+                case INT:
+                    if (type == ID || type == INT || type == RPAREN)
+                        return "Invalid exp!";
                     break;
-                }
                 case PLUS:
                 case MINUS:
                 case TIMES:
                 case DIVIDE:
-                case INDEX: {
-                    if (expStack.size() < 2) throw "Invalid exp!";
-                    syntax::Exp *right = expStack.top();
-                    expStack.pop();
-                    syntax::Exp *left = expStack.top();
-                    expStack.pop();
-
-                    syntax::Exp *arithmetic = nullptr;
-
-                    switch (token.type) {
-                        case PLUS:
-                            arithmetic = syntax::ArithmeticExp::plusExp(left, right);
-                            break;
-                        case MINUS:
-                            arithmetic = syntax::ArithmeticExp::minusExp(left, right);
-                            break;
-                        case TIMES:
-                            arithmetic = syntax::ArithmeticExp::timesExp(left, right);
-                            break;
-                        case DIVIDE:
-                            arithmetic = syntax::ArithmeticExp::divideExp(left, right);
-                            break;
-                        case INDEX:
-                            arithmetic = syntax::ArithmeticExp::indexExp(left, right);
-                            break;
-                        default:
-                            break;
-                    }
-                    expStack.push(arithmetic);
+                case INDEX:
+                    if (type != RPAREN && type != ID && type != INT)
+                        return "Invalid exp!";
                     break;
-                }
-                default:
+                case LPAREN:
+                    ++depth;
                     break;
+                case RPAREN:
+                    if (depth == 0) return "Parenthesis not match!";
+                    --depth;
+                    break;
+                default:
+                    return "Invalid exp!";
             }
         }
 
-        if (expStack.size() != 1) throw "Invalid exp!";
+        if (depth > 0) return "Parenthesis not match!";
+        return "Invalid exp!";
+    }
+
+    syntax::NodeId Parser::parseArithmetic(TokenSpan tokens) {
+        size_t pos = 0;
+        syntax::NodeId exp = parseBinary(tokens, pos, prior(LPAREN) + 1);
+        if (exp != syntax::NO_NODE && pos == tokens.size())
+            return exp;
 
-        return expStack.top();
+        throw diagnose(tokens);
     }
 
-    syntax::LogicalExp *Parser::parseLogical(const std::vector <Token> &tokens) const {
+    syntax::NodeId Parser::parseLogical(TokenSpan tokens) {
         int idx = -1;
         int len = tokens.size();
         for (int i = 0; i < len; ++i) {
@@ -173,93 +150,81 @@ namespace parser {
         }
         if (idx == -1) throw "Invalid if then exp!";
 
-        std::vector <Token> leftTokens(tokens.begin(), tokens.begin() + idx);
-        std::vector <Token> rightTokens(tokens.begin() + idx + 1, tokens.end());
+        TokenSpan leftTokens = tokens.subspan(0, idx);
+        TokenSpan rightTokens = tokens.subspan(idx + 1);
 
         if (leftTokens.empty() || rightTokens.empty()) throw "Invalid if then exp!";
 
-        syntax::Exp *left = parseArithmetic(leftTokens);
-        syntax::Exp *right = parseArithmetic(rightTokens);
+        syntax::NodeId left = parseArithmetic(leftTokens);
+        syntax::NodeId right = parseArithmetic(rightTokens);
 
         switch (tokens[idx].type) {
             case EQ:
-                return syntax::LogicalExp::eqExp(left, right);
+                return arena->logicalExp(syntax::EQ, left, right);
             case NEQ:
-                return syntax::LogicalExp::neqExp(left, right);
+                return arena->logicalExp(syntax::NEQ, left, right);
             case GT:
-                return syntax::LogicalExp::gtExp(left, right);
+                return arena->logicalExp(syntax::GT, left, right);
             case GE:
-                return syntax::LogicalExp::geExp(left, right);
+                return arena->logicalExp(syntax::GE, left, right);
             case LT:
-                return syntax::LogicalExp::ltExp(left, right);
-            case LE:
-                return syntax::LogicalExp::leExp(left, right);
+                return arena->logicalExp(syntax::LT, left, right);
             default:
-                break;
+                return arena->logicalExp(syntax::LE, left, right);
         }
-
-        return nullptr;
     }
 
     int Parser::parseLineno(const Token &token) const {
         if (token.type != parser::INT)
             throw "Invalid line number! Should be integer.";
-        return std::atoi(token.tok.c_str());
+        return token.value;
     }
 
     statement::Statement *
-    Parser::parse(int lineno, const std::string &srcCode, const std::vector <Token> &tokens) const {
+    Parser::parse(syntax::Arena *arena, int lineno, const std::string &srcCode, TokenSpan tokens) {
+        this->arena = arena;
         auto stmtType = getStatementType(tokens);
-        statement::Statement *statement = nullptr;
-        syntax::Exp *exp = nullptr;
+        syntax::NodeId exp = syntax::NO_NODE;
         switch (stmtType) {
             case statement::STMT_REM: {
                 std::string content = StringUtils::getAfter(tokens[0].tok, "REM");
-                exp = new syntax::RemExp(new syntax::StringExp(content));
-                statement = new statement::RemStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                exp = arena->remExp(arena->stringExp(content));
                 break;
             }
             case statement::STMT_PRINT: {
-                std::vector <Token> expTokens(tokens.begin() + 1, tokens.end());
-                exp = new syntax::PrintExp(parseArithmetic(expTokens));
-                statement = new statement::PrintStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                exp = arena->printExp(parseArithmetic(tokens.subspan(1)));
                 break;
             }
             case statement::STMT_INPUT: {
-                std::string var = tokens[1].tok;
-                exp = new syntax::InputExp(new syntax::VarExp(var));
-                statement = new statement::InputStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                std::string var(tokens[1].tok);
+                exp = arena->inputExp(arena->varExp(var));
                 break;
             }
             case statement::STMT_GOTO: {
                 int tgtLineno = parseLineno(tokens[1]);
-                exp = new syntax::GotoExp(new syntax::IntExp(tgtLineno));
-                statement = new statement::GotoStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                exp = arena->gotoExp(arena->intExp(tgtLineno));
                 break;
             }
             case statement::STMT_END: {
-                exp = new syntax::EndExp;
-                statement = new statement::EndStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                exp = arena->endExp();
                 break;
             }
             case statement::STMT_LET: {
-                std::string var = tokens[1].tok;
-                std::vector <Token> expTokens(tokens.begin() + 3, tokens.end());
-                exp = new syntax::LetExp(new syntax::VarExp(var), parseArithmetic(expTokens));
-                statement = new statement::LetStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                std::string var(tokens[1].tok);
+                syntax::NodeId varExp = arena->varExp(var);
+                exp = arena->letExp(varExp, parseArithmetic(tokens.subspan(3)));
                 break;
             }
             case statement::STMT_IF_THEN: {
                 int len = tokens.size();
                 int tgtLineno = parseLineno(tokens[len - 1]);
-                std::vector <Token> expTokens(tokens.begin() + 1, tokens.begin() + (len - 2));
-                exp = new syntax::IfThenExp(parseLogical(expTokens), new syntax::IntExp(tgtLineno));
-                statement = new statement::IfThenStatement(lineno, srcCode, new syntax::SyntaxTree(exp));
+                syntax::NodeId test = parseLogical(tokens.subspan(1, len - 3));
+                exp = arena->ifThenExp(test, arena->intExp(tgtLineno));
                 break;
             }
             default:
-                break;
+                return nullptr;
         }
-        return statement;
+        return statement::Statement::make(stmtType, lineno, srcCode, new syntax::SyntaxTree(arena, exp));
     }
 }
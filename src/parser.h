@@ -2,6 +2,7 @@
 #define PARSER_H
 
 #include <string>
+#include <string_view>
 #include <list>
 #include <iostream>
 #include <vector>
@@ -65,28 +66,65 @@ namespace parser {
             {RPAREN,  "RPAREN"},
     };
 
-    static std::unordered_map<TokenType, int> prior = {
-            {INVALID, 0},
-            {LPAREN,  1},
-            {PLUS,    2},
-            {MINUS,   2},
-            {TIMES,   3},
-            {DIVIDE,  3},
-            {INDEX,   4}
-    };
+    // Priority of the operators, read by the parse threads at once so it is a constant.
+    constexpr int prior(TokenType type) {
+        switch (type) {
+            case LPAREN:
+                return 1;
+            case PLUS:
+            case MINUS:
+                return 2;
+            case TIMES:
+            case DIVIDE:
+                return 3;
+            case INDEX:
+                return 4;
+            default:
+                return 0;
+        }
+    }
 
+    // A token only views the source line it's scanned from, so the line must outlive it.
     class Token {
     public:
-        std::string tok;
+        std::string_view tok;
         TokenType type;
+        // Decoded value of INT token.
+        int value;
 
-        Token(const std::string &tok, TokenType type) : tok(tok), type(type) {}
+        Token(std::string_view tok, TokenType type, int value = 0) : tok(tok), type(type), value(value) {}
 
-        static Token makeToken(const std::string &tok, TokenType type) {
+        static Token makeToken(std::string_view tok, TokenType type) {
             return Token(tok, type);
         }
     };
 
+    // Non-owning view of consecutive tokens.
+    class TokenSpan {
+    public:
+        TokenSpan(const Token *first, size_t len) : first(first), len(len) {}
+
+        TokenSpan(const std::vector <Token> &tokens) : first(tokens.data()), len(tokens.size()) {}
+
+        inline const Token *begin() const { return first; }
+
+        inline const Token *end() const { return first + len; }
+
+        inline size_t size() const { return len; }
+
+        inline bool empty() const { return len == 0; }
+
+        inline const Token &operator[](size_t idx) const { return first[idx]; }
+
+        inline TokenSpan subspan(size_t offset, size_t count) const { return TokenSpan(first + offset, count); }
+
+        inline TokenSpan subspan(size_t offset) const { return TokenSpan(first + offset, len - offset); }
+
+    private:
+        const Token *first;
+        size_t len;
+    };
+
     inline std::ostream &operator<<(std::ostream &os, const Token &token) {
         return os << "(" << token.tok << ", " << typeTable[token.type] << ")";
     }
@@ -95,19 +133,35 @@ namespace parser {
     public:
         Parser() = default;
 
-        statement::StatementType getStatementType(const std::vector <Token> &tokens) const;
+        statement::StatementType getStatementType(TokenSpan tokens) const;
 
-        statement::Statement *parse(int lineno, const std::string &srcCode, const std::vector <Token> &tokens) const;
+        // The nodes of the syntax tree are allocated in arena, so it must outlive the statement.
+        statement::Statement *parse(syntax::Arena *arena, int lineno, const std::string &srcCode, TokenSpan tokens);
 
     private:
-        syntax::Exp *parseArithmetic(const std::vector <Token> &tokens) const;
+        // Arena of the statement being parsed.
+        syntax::Arena *arena = nullptr;
+
+        syntax::NodeId parseArithmetic(TokenSpan tokens);
 
-        syntax::LogicalExp *parseLogical(const std::vector <Token> &tokens) const;
+        syntax::NodeId parseLogical(TokenSpan tokens);
 
         int parseLineno(const Token &token) const;
 
-        // RPN namely reverse polish notation.
-        void computeRPN(const std::vector <Token> &tokens, std::vector <Token> &rpn) const;
+        // Precedence climbing over parser::prior(), parse from pos the operators whose priority >= minPrior.
+        // Return NO_NODE if the tokens don't form an expression, the nodes parsed so far are left in the arena.
+        syntax::NodeId parseBinary(TokenSpan tokens, size_t &pos, int minPrior);
+
+        syntax::NodeId parsePrimary(TokenSpan tokens, size_t &pos);
+
+        // Find out why the tokens are not an expression, scanning them from left to right.
+        const char *diagnose(TokenSpan tokens) const;
+
+        static syntax::ArithmeticOp arithmeticOp(TokenType type);
+
+        static inline bool isArithmeticOp(TokenType type) {
+            return type == PLUS || type == MINUS || type == TIMES || type == DIVIDE || type == INDEX;
+        }
     };
 }
 
@@ -0,0 +1,24 @@
+# Headless console front-end, e.g. qbasic-cli program.txt < input.txt
+
+QT -= core gui
+
+TARGET = qbasic-cli
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+include(qbasic-core.pri)
+
+SOURCES += \
+    bench.cpp \
+    check.cpp \
+    cli.cpp \
+
+HEADERS += \
+    bench.h \
+    check.h \
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
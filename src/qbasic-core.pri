@@ -0,0 +1,31 @@
+# Interpreter core, shared by every front-end. No Qt dependency.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/bytecode.cpp \
+    $$PWD/interpreter.cpp \
+    $$PWD/jit.cpp \
+    $$PWD/lexer.cpp \
+    $$PWD/optimizer.cpp \
+    $$PWD/output.cpp \
+    $$PWD/parser.cpp \
+    $$PWD/source.cpp \
+    $$PWD/statement.cpp \
+    $$PWD/syntax.cpp \
+    $$PWD/transpiler.cpp \
+
+HEADERS += \
+    $$PWD/bytecode.h \
+    $$PWD/interpreter.h \
+    $$PWD/jit.h \
+    $$PWD/lexer.h \
+    $$PWD/optimizer.h \
+    $$PWD/output.h \
+    $$PWD/parser.h \
+    $$PWD/source.h \
+    $$PWD/statement.h \
+    $$PWD/syntax.h \
+    $$PWD/stringutils.h \
+    $$PWD/table.h \
+    $$PWD/transpiler.h
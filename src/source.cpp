@@ -0,0 +1,208 @@
+#include "source.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if defined(__linux__) || defined(__APPLE__)
+#define SOURCE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace source {
+    using statement::RawStatement;
+
+    MappedFile::MappedFile(const std::string &path) {
+#ifdef SOURCE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (regular && st.st_size > 0) {
+            void *memory = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory != MAP_FAILED) {
+                madvise(memory, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char *>(memory);
+                size = st.st_size;
+                mapped = true;
+            }
+        }
+        close(fd);
+        // An empty file has nothing to map.
+        if (mapped || (regular && st.st_size == 0)) {
+            opened = true;
+            return;
+        }
+#endif
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return;
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        opened = true;
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef SOURCE_MMAP
+        if (mapped)
+            munmap(const_cast<char *>(data), size);
+#endif
+    }
+
+    std::string_view nextLine(std::string_view text, size_t &pos) {
+        size_t start = pos;
+        auto newline = static_cast<const char *>(std::memchr(text.data() + start, '\n', text.size() - start));
+        size_t end = newline ? newline - text.data() : text.size();
+        pos = end + 1;
+        return text.substr(start, end - start);
+    }
+
+    static bool linenoLess(const RawStatement &left, const RawStatement &right) {
+        return left.lineno < right.lineno;
+    }
+
+    // Give line the source of other, drop its parsed statement if that changes it.
+    static void assign(RawStatement &line, RawStatement &&other) {
+        if (line.srcCode != other.srcCode) {
+            line.srcCode = std::move(other.srcCode);
+            line.parsed.reset();
+        }
+    }
+
+    RawStatement *Listing::find(int lineno) {
+        if (blocks.empty())
+            return nullptr;
+        auto &block = blocks[blockOf(lineno)];
+        auto it = position(block, lineno);
+        return it != block.end() && it->lineno == lineno ? &*it : nullptr;
+    }
+
+    void Listing::set(RawStatement &&line) {
+        if (blocks.empty()) {
+            blocks.emplace_back();
+            blocks.back().push_back(std::move(line));
+            ++count;
+            return;
+        }
+        size_t index = blockOf(line.lineno);
+        auto &block = blocks[index];
+        auto it = position(block, line.lineno);
+        if (it != block.end() && it->lineno == line.lineno) {
+            assign(*it, std::move(line));
+            return;
+        }
+        block.insert(it, std::move(line));
+        ++count;
+        startsValid = false;
+
+        if (block.size() >= 2 * BLOCK) {
+            std::vector <RawStatement> upper(std::make_move_iterator(block.begin() + BLOCK),
+                                             std::make_move_iterator(block.end()));
+            block.erase(block.begin() + BLOCK, block.end());
+            blocks.insert(blocks.begin() + index + 1, std::move(upper));
+        }
+    }
+
+    bool Listing::erase(int lineno) {
+        if (blocks.empty())
+            return false;
+        size_t index = blockOf(lineno);
+        auto &block = blocks[index];
+        auto it = position(block, lineno);
+        if (it == block.end() || it->lineno != lineno)
+            return false;
+        block.erase(it);
+        --count;
+        startsValid = false;
+        if (block.empty())
+            blocks.erase(blocks.begin() + index);
+        return true;
+    }
+
+    void Listing::merge(std::vector <RawStatement> &&lines) {
+        // A file is usually in order already, stable keeps the lines of the same number in order.
+        if (!std::is_sorted(lines.begin(), lines.end(), linenoLess))
+            std::stable_sort(lines.begin(), lines.end(), linenoLess);
+
+        std::vector <RawStatement> merged;
+        merged.reserve(count + lines.size());
+        auto add = [&merged](RawStatement &&line) {
+            if (!merged.empty() && merged.back().lineno == line.lineno)
+                assign(merged.back(), std::move(line));
+            else
+                merged.push_back(std::move(line));
+        };
+        // An old line goes first, so a new one of the same number replaces it.
+        auto next = lines.begin();
+        for (auto &block: blocks) {
+            for (auto &line: block) {
+                for (; next != lines.end() && next->lineno < line.lineno; ++next)
+                    add(std::move(*next));
+                add(std::move(line));
+            }
+        }
+        for (; next != lines.end(); ++next)
+            add(std::move(*next));
+
+        blocks.clear();
+        count = merged.size();
+        startsValid = false;
+        for (size_t i = 0; i < count; i += BLOCK) {
+            auto first = merged.begin() + i;
+            auto last = merged.begin() + std::min(i + BLOCK, count);
+            blocks.emplace_back(std::make_move_iterator(first), std::make_move_iterator(last));
+        }
+    }
+
+    void Listing::clear() {
+        blocks.clear();
+        count = 0;
+        startsValid = false;
+    }
+
+    size_t Listing::indexOf(int lineno) {
+        if (blocks.empty())
+            return 0;
+        indexBlocks();
+        size_t index = blockOf(lineno);
+        auto &block = blocks[index];
+        return starts[index] + (position(block, lineno) - block.begin());
+    }
+
+    RawStatement &Listing::at(size_t index) {
+        indexBlocks();
+        size_t block = std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1;
+        return blocks[block][index - starts[block]];
+    }
+
+    void Listing::indexBlocks() {
+        if (startsValid)
+            return;
+        starts.clear();
+        size_t start = 0;
+        for (auto &block: blocks) {
+            starts.push_back(start);
+            start += block.size();
+        }
+        startsValid = true;
+    }
+
+    size_t Listing::blockOf(int lineno) const {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), lineno,
+                                   [](int lineno, const std::vector <RawStatement> &block) {
+                                       return lineno < block.front().lineno;
+                                   });
+        return it == blocks.begin() ? 0 : it - blocks.begin() - 1;
+    }
+
+    std::vector<RawStatement>::iterator Listing::position(std::vector <RawStatement> &block, int lineno) {
+        return std::lower_bound(block.begin(), block.end(), lineno, [](const RawStatement &line, int lineno) {
+            return line.lineno < lineno;
+        });
+    }
+}
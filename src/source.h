@@ -0,0 +1,141 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "statement.h"
+
+namespace source {
+    // A file mapped read-only into memory, or read into a buffer if it can't be mapped, e.g. a pipe.
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::string &path);
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        inline bool isOpen() const {
+            return opened;
+        }
+
+        inline std::string_view text() const {
+            return std::string_view(data, size);
+        }
+
+    private:
+        bool opened = false;
+
+        bool mapped = false;
+
+        const char *data = nullptr;
+
+        size_t size = 0;
+
+        std::string buffer;
+    };
+
+    // The line of text at pos without its '\n', and move pos to the next one. Lines are split in place
+    // with memchr, which the C library vectorizes.
+    std::string_view nextLine(std::string_view text, size_t &pos);
+
+    // Lines of the program in line number order. The lines are stored by value in blocks of consecutive lines:
+    // a line is found by binary search over the blocks then within its block, and an edit moves at most one block.
+    class Listing {
+    public:
+        class Iterator {
+        public:
+            Iterator(std::vector <std::vector<statement::RawStatement>> *blocks, size_t block)
+                    : blocks(blocks), block(block) {}
+
+            inline statement::RawStatement &operator*() const {
+                return (*blocks)[block][index];
+            }
+
+            inline statement::RawStatement *operator->() const {
+                return &(*blocks)[block][index];
+            }
+
+            inline Iterator &operator++() {
+                if (++index == (*blocks)[block].size()) {
+                    ++block;
+                    index = 0;
+                }
+                return *this;
+            }
+
+            inline bool operator!=(const Iterator &other) const {
+                return block != other.block || index != other.index;
+            }
+
+        private:
+            std::vector <std::vector<statement::RawStatement>> *blocks;
+            size_t block;
+            size_t index = 0;
+        };
+
+        Listing() = default;
+
+        // The line, nullptr if there is none.
+        statement::RawStatement *find(int lineno);
+
+        // Insert the line in order, or replace the source of the line with the same number. Its parsed
+        // statement is kept if the source is the same.
+        void set(statement::RawStatement &&line);
+
+        // false if there is no such line.
+        bool erase(int lineno);
+
+        // Set many lines at once, in any order, the last one wins if a number is given twice.
+        void merge(std::vector <statement::RawStatement> &&lines);
+
+        void clear();
+
+        // Position of the line in order, or where it would go, e.g. its row in a view.
+        size_t indexOf(int lineno);
+
+        // The index-th line in order.
+        statement::RawStatement &at(size_t index);
+
+        inline size_t size() const {
+            return count;
+        }
+
+        inline Iterator begin() {
+            return Iterator(&blocks, 0);
+        }
+
+        inline Iterator end() {
+            return Iterator(&blocks, blocks.size());
+        }
+
+    private:
+        // Lines per block after a merge, a block splits when it has twice as many.
+        static const size_t BLOCK = 256;
+
+        // None is empty.
+        std::vector <std::vector<statement::RawStatement>> blocks;
+
+        size_t count = 0;
+
+        // Position of the first line of each block, rebuilt when first needed after lines are inserted or erased.
+        std::vector <size_t> starts;
+
+        bool startsValid = false;
+
+        void indexBlocks();
+
+        // Index of the block that holds lineno, or where it would go.
+        size_t blockOf(int lineno) const;
+
+        // Position of lineno in the block, or where it would go.
+        static std::vector<statement::RawStatement>::iterator
+        position(std::vector <statement::RawStatement> &block, int lineno);
+    };
+}
+
+#endif // SOURCE_H
@@ -1,18 +1,40 @@
 #include "statement.h"
-#include "stringutils.h"
 #include <exception>
 
 namespace statement {
-    RawStatement *RawStatement::fromCmdline(const std::string &cmdline) {
+    RawStatement RawStatement::fromCmdline(std::string_view cmdline) {
         if (valid(cmdline)) {
-            std::vector <std::string> linenoAndSrcCode;
-            StringUtils::split(cmdline, linenoAndSrcCode, 2);
-            int lineno = std::atoi(linenoAndSrcCode[0].c_str());
-            std::string srcCode = linenoAndSrcCode[1];
+            // Digits up to the first space, stop counting once out of range.
+            size_t space = cmdline.find(' ');
+            int lineno = 0;
+            for (size_t i = 0; i < space && lineno <= 1000000; ++i)
+                lineno = lineno * 10 + (cmdline[i] - '0');
             if (lineno < 0 || lineno > 1000000)
                 throw "Invalid Statement! Should contain line number! Line number should be >= 0 and <= 1000000!";
-            return new RawStatement(lineno, srcCode);
+            return RawStatement(lineno, std::string(cmdline.substr(space + 1)));
         }
         throw "Invalid Statement! Should contain line number and statement!";
     }
+
+    Statement *Statement::make(StatementType type, int lineno, const std::string &srcCode, SyntaxTree *syntaxTree) {
+        switch (type) {
+            case STMT_REM:
+                return new RemStatement(lineno, srcCode, syntaxTree);
+            case STMT_PRINT:
+                return new PrintStatement(lineno, srcCode, syntaxTree);
+            case STMT_INPUT:
+                return new InputStatement(lineno, srcCode, syntaxTree);
+            case STMT_GOTO:
+                return new GotoStatement(lineno, srcCode, syntaxTree);
+            case STMT_END:
+                return new EndStatement(lineno, srcCode, syntaxTree);
+            case STMT_LET:
+                return new LetStatement(lineno, srcCode, syntaxTree);
+            case STMT_IF_THEN:
+                return new IfThenStatement(lineno, srcCode, syntaxTree);
+            default:
+                delete syntaxTree;
+                return new ErrorStatement(lineno);
+        }
+    }
 }
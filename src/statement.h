@@ -2,8 +2,8 @@
 #define STATEMENT_H
 
 #include <string>
-#include <regex>
-#include <QMainWindow>
+#include <string_view>
+#include <memory>
 #include "syntax.h"
 
 using SyntaxTree = syntax::SyntaxTree;
@@ -19,6 +19,15 @@ namespace statement {
         STMT_END,
     };
 
+    // A statement as parsed and validated, before the interpreter and the optimizer change it. Its tree is only
+    // printed when a front-end asks for it, see syntax::SyntaxTree::outline.
+    struct ParsedStatement {
+        // STMT_INVALID if it can't be parsed, then only errorMsg is set.
+        StatementType type = STMT_INVALID;
+        syntax::Fragment tree;
+        std::string errorMsg;
+    };
+
     class RawStatement {
     public:
         RawStatement(int lineno, const std::string &srcCode) : lineno(lineno), srcCode(srcCode) {};
@@ -27,19 +36,34 @@ namespace statement {
 
         ~RawStatement() = default;
 
-        static RawStatement *fromCmdline(const std::string &cmdline);
+        RawStatement(RawStatement &&) = default;
+
+        RawStatement &operator=(RawStatement &&) = default;
+
+        static RawStatement fromCmdline(std::string_view cmdline);
 
         inline std::string toString() const {
             return std::to_string(lineno) + " " + srcCode;
         }
 
-        inline static bool valid(const std::string &cmdline) {
-            static std::regex pattern("^[1-9]\\d* .*$");
-            return std::regex_match(cmdline, pattern);
+        // Matches ^[1-9]\d* .*$, without a regex as a whole file goes through it.
+        inline static bool valid(std::string_view cmdline) {
+            size_t i = 0, len = cmdline.size();
+            if (len == 0 || cmdline[0] < '1' || cmdline[0] > '9')
+                return false;
+            while (i < len && cmdline[i] >= '0' && cmdline[i] <= '9')
+                ++i;
+            if (i == len || cmdline[i] != ' ')
+                return false;
+            // . doesn't match line terminators.
+            return cmdline.find_first_of("\r\n", i) == std::string_view::npos;
         }
 
         int lineno;
         std::string srcCode;
+
+        // srcCode as last parsed, reused by the next runs until srcCode changes.
+        std::unique_ptr <ParsedStatement> parsed;
     };
 
     class Statement {
@@ -47,7 +71,15 @@ namespace statement {
         Statement(int lineno, const std::string &srcCode, SyntaxTree *syntaxTree) : lineno(lineno), srcCode(srcCode),
                                                                                     syntaxTree(syntaxTree) {};
 
-        virtual ~Statement() = default;
+        // The nodes are left in the arena, which drops them all at once.
+        virtual ~Statement() {
+            delete syntaxTree;
+        }
+
+        // A statement of the type, as the parser makes it.
+        static Statement *make(StatementType type, int lineno, const std::string &srcCode, SyntaxTree *syntaxTree);
+
+        virtual StatementType getType() const = 0;
 
         inline int getLineno() const {
             return lineno;
@@ -61,17 +93,32 @@ namespace statement {
             return std::to_string(lineno) + " " + srcCode;
         }
 
-        inline void checkValidation(MainWindow *mainwindow) const {
-            syntaxTree->checkValidation(mainwindow);
+        inline SyntaxTree *getSyntaxTree() const {
+            return syntaxTree;
         }
 
-        virtual void run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-            syntaxTree->run(mainWindow, resultDisplay);
+        inline void checkValidation(interpreter::Interpreter *interpreter) const {
+            syntaxTree->checkValidation(interpreter);
         }
 
-        virtual void clear() {
-            syntaxTree->clear();
-            delete syntaxTree;
+        virtual void resolve(interpreter::Interpreter *interpreter) {
+            syntaxTree->resolve(interpreter);
+        }
+
+        virtual void link(interpreter::Interpreter *interpreter) {
+            syntaxTree->link(interpreter);
+        }
+
+        virtual void run(interpreter::Interpreter *interpreter) {
+            syntaxTree->run(interpreter);
+        }
+
+        virtual void compile(bytecode::Compiler *compiler) {
+            syntaxTree->compile(compiler);
+        }
+
+        virtual void fold(optimizer::Folder *folder) {
+            syntaxTree->fold(folder);
         }
 
         virtual inline void print(std::string &str) {
@@ -90,15 +137,32 @@ namespace statement {
     public:
         ErrorStatement(int lineno) : Statement(lineno, "", nullptr) {};
 
-        inline void clear() override {}
+        inline StatementType getType() const override {
+            return STMT_INVALID;
+        }
 
         inline void print(std::string &str) override {
             str += std::to_string(lineno) + " Error\n";
         }
 
-        inline void run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override {
-            Q_UNUSED(mainWindow);
-            Q_UNUSED(resultDisplay);
+        inline void resolve(interpreter::Interpreter *interpreter) override {
+            (void) interpreter;
+        }
+
+        inline void link(interpreter::Interpreter *interpreter) override {
+            (void) interpreter;
+        }
+
+        inline void run(interpreter::Interpreter *interpreter) override {
+            (void) interpreter;
+        }
+
+        inline void compile(bytecode::Compiler *compiler) override {
+            (void) compiler;
+        }
+
+        inline void fold(optimizer::Folder *folder) override {
+            (void) folder;
         }
     };
 
@@ -109,6 +173,10 @@ namespace statement {
                                                                                                  syntaxTree) {}
 
         ~RemStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_REM;
+        }
     };
 
     class PrintStatement : public Statement {
@@ -118,6 +186,10 @@ namespace statement {
                                                                                                    syntaxTree) {}
 
         ~PrintStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_PRINT;
+        }
     };
 
     class InputStatement : public Statement {
@@ -127,6 +199,10 @@ namespace statement {
                                                                                                    syntaxTree) {}
 
         ~InputStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_INPUT;
+        }
     };
 
     class GotoStatement : public Statement {
@@ -136,6 +212,10 @@ namespace statement {
                                                                                                   syntaxTree) {}
 
         ~GotoStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_GOTO;
+        }
     };
 
     class LetStatement : public Statement {
@@ -145,6 +225,10 @@ namespace statement {
                                                                                                  syntaxTree) {}
 
         ~LetStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_LET;
+        }
     };
 
     class IfThenStatement : public Statement {
@@ -154,6 +238,10 @@ namespace statement {
                                                                                                     syntaxTree) {}
 
         ~IfThenStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_IF_THEN;
+        }
     };
 
     class EndStatement : public Statement {
@@ -163,6 +251,10 @@ namespace statement {
                                                                                                  syntaxTree) {}
 
         ~EndStatement() = default;
+
+        inline StatementType getType() const override {
+            return STMT_END;
+        }
     };
 }
 
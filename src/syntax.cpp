@@ -1,218 +1,557 @@
 #include "syntax.h"
-#include <cmath>
+#include "optimizer.h"
 
 namespace syntax {
-    void PrintExp::checkValidation(MainWindow *mainWindow) {
-        exp->checkValidation(mainWindow);
-    }
+    class Printer : public Visitor<Printer> {
+    public:
+        Printer(Arena &arena, std::vector <OutlineRow> &rows) : Visitor(arena), rows(rows) {}
 
-    ExpVal PrintExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        Q_UNUSED(mainWindow);
-        ExpVal varVal = exp->run(mainWindow, resultDisplay);
-        if (varVal.type == INT)
-            resultDisplay->append(QString::number(varVal.iVal));
-        else if (varVal.type == STRING)
-            resultDisplay->append(QString::fromStdString(varVal.sVal));
-        else
-            throw "Use undefined variable!";
-        return ExpVal::voidValue();
-    }
+        void print(NodeId id, int depth) {
+            int lastDepth = this->depth;
+            this->depth = depth;
+            visit(id);
+            this->depth = lastDepth;
+        }
 
-    ExpVal InputExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        Q_UNUSED(resultDisplay);
-        mainWindow->input(var->getSymbol());
-        return ExpVal::voidValue();
-    }
+        void visitString(Node &node) {
+            row(arena.string(node));
+        }
 
-    ExpVal GotoExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        Q_UNUSED(resultDisplay);
-        mainWindow->gotoLine(lineno->getValue());
-        return ExpVal::voidValue();
-    }
+        void visitInt(Node &node) {
+            row(std::to_string(node.value));
+        }
 
-    ExpVal EndExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        Q_UNUSED(resultDisplay);
-        mainWindow->end();
-        return ExpVal::voidValue();
-    }
+        void visitRem(Node &node) {
+            row("REM");
+            print(node.left, depth + 1);
+        }
 
-    void ArithmeticExp::checkValidation(MainWindow *mainWindow) {
-        left->checkValidation(mainWindow);
-        right->checkValidation(mainWindow);
-    }
+        void visitVar(Node &node) {
+            row(arena.string(node));
+        }
 
-    void ArithmeticExp::print(std::string &str, int depth) {
-        indent(str, depth);
-        switch (op) {
-            case PLUS_OP:
-                str += '+';
-                break;
-            case MINUS_OP:
-                str += '-';
-                break;
-            case TIMES_OP:
-                str += '*';
-                break;
-            case DIVIDE_OP:
-                str += '/';
-                break;
-            case INDEX_OP:
-                str += "**";
-                break;
+        void visitPrint(Node &node) {
+            row("PRINT");
+            print(node.left, depth + 1);
         }
-        str += '\n';
-        left->print(str, depth + 1);
-        str += '\n';
-        right->print(str, depth + 1);
-    }
 
-    ExpVal ArithmeticExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        ExpVal leftVal = left->run(mainWindow, resultDisplay);
-        ExpVal rightVal = right->run(mainWindow, resultDisplay);
-
-        if (leftVal.type != INT || rightVal.type != INT)
-            throw "Arithmetic operation only supports int!";
-        if (op == DIVIDE_OP && rightVal.iVal == 0)
-            throw "Divided by zero!";
-        // 0 ** 0, 0 ** -1 is no valid, but 0 ** 1 is valid.
-        if (op == INDEX_OP && leftVal.iVal == 0 && rightVal.iVal <= 0)
-            throw "Invalid index operation!";
-
-        switch (op) {
-            case PLUS_OP:
-                return ExpVal(leftVal.iVal + rightVal.iVal);
-            case MINUS_OP:
-                return ExpVal(leftVal.iVal - rightVal.iVal);
-            case TIMES_OP:
-                return ExpVal(leftVal.iVal * rightVal.iVal);
-            case DIVIDE_OP:
-                if (rightVal.iVal == 0) throw "Divided by zero!";
-                return ExpVal(leftVal.iVal / rightVal.iVal);
-            case INDEX_OP:
-                return ExpVal(int(pow(leftVal.iVal, rightVal.iVal)));
-            default:
-                break;
-        }
-        throw "Non-existent operation type!";
-    }
+        void visitInput(Node &node) {
+            row("INPUT");
+            print(node.left, depth + 1);
+        }
 
-    void LetExp::checkValidation(MainWindow *mainWindow) {
-        if (typeid(*val) != typeid(StringExp) && typeid(*val) != typeid(IntExp) &&
-            typeid(*val) != typeid(ArithmeticExp))
-            throw "Invalid assignment value!";
-        var->checkValidation(mainWindow);
-        val->checkValidation(mainWindow);
-    }
+        void visitGoto(Node &node) {
+            row("GOTO");
+            print(node.left, depth + 1);
+        }
 
-    ExpVal LetExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        if (typeid(*val) != typeid(StringExp) && typeid(*val) != typeid(IntExp) &&
-            typeid(*val) != typeid(ArithmeticExp))
-            throw "Invalid assignment value!";
+        void visitEnd(Node &node) {
+            (void) node;
+            row("END");
+        }
 
-        ExpVal expVal = val->run(mainWindow, resultDisplay);
-        std::string varSymbol = var->getSymbol();
+        void visitArithmetic(Node &node) {
+            switch (node.op) {
+                case PLUS_OP:
+                    row("+");
+                    break;
+                case MINUS_OP:
+                    row("-");
+                    break;
+                case TIMES_OP:
+                    row("*");
+                    break;
+                case DIVIDE_OP:
+                    row("/");
+                    break;
+                case INDEX_OP:
+                    row("**");
+                    break;
+            }
+            print(node.left, depth + 1);
+            print(node.right, depth + 1);
+        }
 
-        if (expVal.type == INT) {
-            mainWindow->tenv->enter(varSymbol, env::INT);
-            mainWindow->venv->enter(varSymbol, expVal.iVal);
-        } else {
-            mainWindow->tenv->enter(varSymbol, env::STRING);
-            mainWindow->venv->enter(varSymbol, expVal.sVal);
+        void visitLet(Node &node) {
+            row("LET =");
+            print(node.left, depth + 1);
+            print(node.right, depth + 1);
         }
 
-        return ExpVal::voidValue();
-    }
+        // The operands are printed beside the test.
+        void visitLogical(Node &node) {
+            switch (node.op) {
+                case EQ:
+                    row("=");
+                    break;
+                case NEQ:
+                    row("<>");
+                    break;
+                case GT:
+                    row(">");
+                    break;
+                case GE:
+                    row(">=");
+                    break;
+                case LT:
+                    row("<");
+                    break;
+                case LE:
+                    row("<=");
+                    break;
+            }
+            print(node.left, depth);
+            print(node.right, depth);
+        }
+
+        void visitIfThen(Node &node) {
+            row("IF THEN");
+            print(node.left, depth + 1);
+            print(node.right, depth + 1);
+        }
+
+        void visitInc(Node &node) {
+            row("LET =");
+            print(node.left, depth + 1);
+            rows.push_back(OutlineRow{depth + 1, "+"});
+            print(node.left, depth + 2);
+            print(node.right, depth + 2);
+        }
+
+        void visitBranch(Node &node) {
+            visitIfThen(node);
+        }
+
+    private:
+        std::vector <OutlineRow> &rows;
+        int depth = 0;
+
+        inline void row(const std::string &label) {
+            rows.push_back(OutlineRow{depth, label});
+        }
+    };
+
+    class Validator : public Visitor<Validator> {
+    public:
+        Validator(Arena &arena) : Visitor(arena) {}
+
+        void visitVar(Node &node) {
+            (void) node;
+            // just do nothing, since in this stage the variable won't have been defined.
+        }
+
+        void visitGoto(Node &node) {
+            int lineno = arena[node.left].value;
+            if (lineno <= 0 || lineno > 1000000)
+                throw "Invalid line number!";
+        }
+
+        void visitLet(Node &node) {
+            if (!isAssignable(arena[node.right]))
+                throw "Invalid assignment value!";
+            visitChildren(node);
+        }
+
+        void visitIfThen(Node &node) {
+            visit(node.left);
+            int lineno = arena[node.right].value;
+            if (lineno <= 0 || lineno > 100000)
+                throw "Invalid line number!";
+        }
+
+        static inline bool isAssignable(const Node &val) {
+            return val.kind == STRING_EXP || val.kind == INT_EXP || val.kind == ARITHMETIC_EXP;
+        }
+    };
+
+    class Evaluator : public Visitor<Evaluator, ExpVal> {
+    public:
+        Evaluator(Arena &arena, Interpreter *interpreter) : Visitor(arena), interpreter(interpreter) {}
+
+        ExpVal visitString(Node &node) {
+            return ExpVal(&arena.string(node));
+        }
+
+        ExpVal visitInt(Node &node) {
+            return ExpVal(node.value);
+        }
+
+        ExpVal visitRem(Node &node) {
+            (void) node;
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitVar(Node &node) {
+            const env::Variable &variable = interpreter->variables[node.value];
+            if (!variable.defined)
+                throw "Use undefined variable!";
+            if (variable.type == env::INT)
+                return ExpVal(variable.value.getInt());
+            else
+                return ExpVal(&variable.value.getString());
+        }
+
+        ExpVal visitPrint(Node &node) {
+            if (arena[node.left].isInt()) {
+                interpreter->print(std::to_string(evalInt(arena[node.left])));
+                return ExpVal::voidValue();
+            }
+            ExpVal varVal = visit(node.left);
+            if (varVal.type == INT)
+                interpreter->print(std::to_string(varVal.iVal));
+            else if (varVal.type == STRING)
+                interpreter->print(*varVal.sVal);
+            else
+                throw "Use undefined variable!";
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitInput(Node &node) {
+            interpreter->input(arena.string(arena[node.left]));
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitGoto(Node &node) {
+            interpreter->jump(node.value);
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitEnd(Node &node) {
+            (void) node;
+            interpreter->end();
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitArithmetic(Node &node) {
+            if (node.intOnly)
+                return ExpVal(evalInt(node));
+            ExpVal leftVal = visit(node.left);
+            ExpVal rightVal = visit(node.right);
+
+            if (leftVal.type != INT || rightVal.type != INT)
+                throw "Arithmetic operation only supports int!";
+            return ExpVal(applyArithmetic(ArithmeticOp(node.op), leftVal.iVal, rightVal.iVal));
+        }
+
+        ExpVal visitLet(Node &node) {
+            if (arena[node.right].isInt()) {
+                interpreter->variables[arena[node.left].value].set(evalInt(arena[node.right]));
+                if (node.op)
+                    fusedGoto(node);
+                return ExpVal::voidValue();
+            }
+            if (!Validator::isAssignable(arena[node.right]))
+                throw "Invalid assignment value!";
+
+            ExpVal expVal = visit(node.right);
+            env::Variable &variable = interpreter->variables[arena[node.left].value];
+
+            if (expVal.type == INT)
+                variable.set(expVal.iVal);
+            else
+                variable.set(*expVal.sVal);
+
+            if (node.op)
+                fusedGoto(node);
+            return ExpVal::voidValue();
+        }
 
-    void LogicalExp::checkValidation(MainWindow *mainWindow) {
-        left->checkValidation(mainWindow);
-        right->checkValidation(mainWindow);
+        ExpVal visitLogical(Node &node) {
+            if (node.intOnly)
+                return ExpVal(evalInt(node));
+            ExpVal leftVal = visit(node.left);
+            ExpVal rightVal = visit(node.right);
+            if (leftVal.type != INT || rightVal.type != INT)
+                throw "Logical operation only supports int!";
+            return ExpVal(applyLogical(LogicOp(node.op), leftVal.iVal, rightVal.iVal));
+        }
+
+        ExpVal visitIfThen(Node &node) {
+            int test = arena[node.left].isInt() ? evalInt(arena[node.left]) : visit(node.left).iVal;
+            if (test == 1) {
+                interpreter->jump(node.value);
+            }
+
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitInc(Node &node) {
+            env::Variable &variable = interpreter->variables[arena[node.left].value];
+            if (!node.intOnly) {
+                if (!variable.defined)
+                    throw "Use undefined variable!";
+                if (variable.type != env::INT)
+                    throw "Arithmetic operation only supports int!";
+            }
+            variable.set(variable.value.getInt() + arena[node.right].value);
+            ++interpreter->fused.increments;
+
+            if (node.op)
+                fusedGoto(node);
+            return ExpVal::voidValue();
+        }
+
+        ExpVal visitBranch(Node &node) {
+            const Node &test = arena[node.left];
+            const env::Variable &variable = interpreter->variables[arena[test.left].value];
+            if (!node.intOnly) {
+                if (!variable.defined)
+                    throw "Use undefined variable!";
+                if (variable.type != env::INT)
+                    throw "Logical operation only supports int!";
+            }
+            ++interpreter->fused.branches;
+
+            if (applyLogical(LogicOp(test.op), variable.value.getInt(), arena[test.right].value) == 1)
+                interpreter->jump(node.value);
+            return ExpVal::voidValue();
+        }
+
+    private:
+        Interpreter *interpreter;
+
+        // Evaluate an exp proven to be an int, see Node::isInt.
+        int evalInt(const Node &node) {
+            if (node.kind == INT_EXP)
+                return node.value;
+            if (node.kind == VAR_EXP)
+                return interpreter->variables[node.value].value.getInt();
+            // Left first, as the errors are reported in order.
+            int left = evalInt(arena[node.left]);
+            int right = evalInt(arena[node.right]);
+            if (node.kind == ARITHMETIC_EXP)
+                return applyArithmetic(ArithmeticOp(node.op), left, right);
+            return applyLogical(LogicOp(node.op), left, right);
+        }
+
+        // Skip the GOTO following the statement, its target is sure to exist.
+        inline void fusedGoto(const Node &node) {
+            ++interpreter->fused.gotos;
+            interpreter->jump(node.value);
+        }
+    };
+
+    class Resolver : public Visitor<Resolver> {
+    public:
+        Resolver(Arena &arena, Interpreter *interpreter) : Visitor(arena), interpreter(interpreter) {}
+
+        void visitVar(Node &node) {
+            node.value = interpreter->resolve(arena.string(node));
+        }
+
+    private:
+        Interpreter *interpreter;
+    };
+
+    class Linker : public Visitor<Linker> {
+    public:
+        Linker(Arena &arena, Interpreter *interpreter) : Visitor(arena), interpreter(interpreter) {}
+
+        void visitGoto(Node &node) {
+            node.value = interpreter->target(arena[node.left].value);
+        }
+
+        void visitIfThen(Node &node) {
+            node.value = interpreter->target(arena[node.right].value);
+        }
+
+    private:
+        Interpreter *interpreter;
+    };
+
+    class Emitter : public Visitor<Emitter> {
+    public:
+        Emitter(Arena &arena, bytecode::Compiler *compiler) : Visitor(arena), compiler(compiler) {}
+
+        void visitString(Node &node) {
+            compiler->append(bytecode::PUSH_STR, compiler->constString(arena.string(node)));
+        }
+
+        void visitInt(Node &node) {
+            compiler->append(bytecode::PUSH_INT, node.value);
+        }
+
+        void visitRem(Node &node) {
+            (void) node;
+        }
+
+        void visitVar(Node &node) {
+            compiler->append(node.intOnly ? bytecode::LOAD_INT : bytecode::LOAD, node.value);
+        }
+
+        void visitPrint(Node &node) {
+            visit(node.left);
+            compiler->append(bytecode::PRINT);
+        }
+
+        void visitInput(Node &node) {
+            compiler->append(bytecode::INPUT, arena[node.left].value);
+        }
+
+        void visitGoto(Node &node) {
+            compiler->appendJump(bytecode::JUMP, node.value);
+        }
+
+        void visitEnd(Node &node) {
+            (void) node;
+            compiler->append(bytecode::HALT);
+        }
+
+        void visitArithmetic(Node &node) {
+            visit(node.left);
+            visit(node.right);
+            switch (node.op) {
+                case PLUS_OP:
+                    compiler->append(bytecode::ADD);
+                    break;
+                case MINUS_OP:
+                    compiler->append(bytecode::SUB);
+                    break;
+                case TIMES_OP:
+                    compiler->append(bytecode::MUL);
+                    break;
+                case DIVIDE_OP:
+                    compiler->append(bytecode::DIV);
+                    break;
+                case INDEX_OP:
+                    compiler->append(bytecode::POW);
+                    break;
+            }
+        }
+
+        void visitLet(Node &node) {
+            visit(node.right);
+            if (node.op)
+                compiler->appendJump(bytecode::STORE_JUMP, node.value, arena[node.left].value);
+            else
+                compiler->append(bytecode::STORE, arena[node.left].value);
+        }
+
+        void visitInc(Node &node) {
+            int slot = arena[node.left].value;
+            int increment = arena[node.right].value;
+            if (node.op)
+                compiler->appendJump(bytecode::INC_JUMP, node.value, slot, increment);
+            else
+                compiler->append(bytecode::INC, slot, increment);
+        }
+
+        void visitLogical(Node &node) {
+            visit(node.left);
+            visit(node.right);
+            switch (node.op) {
+                case EQ:
+                    compiler->append(bytecode::CMP_EQ);
+                    break;
+                case NEQ:
+                    compiler->append(bytecode::CMP_NEQ);
+                    break;
+                case GT:
+                    compiler->append(bytecode::CMP_GT);
+                    break;
+                case GE:
+                    compiler->append(bytecode::CMP_GE);
+                    break;
+                case LT:
+                    compiler->append(bytecode::CMP_LT);
+                    break;
+                case LE:
+                    compiler->append(bytecode::CMP_LE);
+                    break;
+            }
+        }
+
+        void visitIfThen(Node &node) {
+            visit(node.left);
+            compiler->appendJump(bytecode::JUMP_IF, node.value);
+        }
+
+        void visitBranch(Node &node) {
+            const Node &test = arena[node.left];
+            auto op = bytecode::OpCode(bytecode::BRANCH_EQ + test.op);
+            compiler->appendJump(op, node.value, arena[test.left].value, arena[test.right].value);
+        }
+
+    private:
+        bytecode::Compiler *compiler;
+    };
+
+    // Only STRING_EXP and VAR_EXP have a string.
+    static inline bool hasString(const Node &node) {
+        return node.kind == STRING_EXP || node.kind == VAR_EXP;
     }
 
-    void LogicalExp::print(std::string &str, int depth) {
-        indent(str, depth);
-        switch (op) {
-            case EQ:
-                str += '=';
-                break;
-            case NEQ:
-                str += "<>";
-                break;
-            case GT:
-                str += '>';
-                break;
-            case GE:
-                str += ">=";
-                break;
-            case LT:
-                str += '<';
-                break;
-            case LE:
-                str += "<=";
-                break;
+    Fragment Arena::extract(std::pair<NodeId, uint32_t> mark, NodeId root) const {
+        Fragment fragment;
+        fragment.nodes.assign(nodes.begin() + mark.first, nodes.end());
+        fragment.strings.assign(strings.begin() + mark.second, strings.end());
+        for (auto &node: fragment.nodes) {
+            if (node.left != NO_NODE)
+                node.left -= mark.first;
+            if (node.right != NO_NODE)
+                node.right -= mark.first;
+            if (hasString(node))
+                node.str -= mark.second;
         }
-        str += '\n';
-        left->print(str, depth);
-        str += '\n';
-        right->print(str, depth);
+        fragment.root = root - mark.first;
+        return fragment;
     }
 
-    ExpVal LogicalExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        ExpVal leftVal = left->run(mainWindow, resultDisplay);
-        ExpVal rightVal = right->run(mainWindow, resultDisplay);
-        if (leftVal.type != INT || rightVal.type != INT)
-            throw "Logical operation only supports int!";
-
-        bool _true = false;
-        switch (op) {
-            case EQ:
-                _true = leftVal.iVal == rightVal.iVal;
-                break;
-            case NEQ:
-                _true = leftVal.iVal != rightVal.iVal;
-                break;
-            case GT:
-                _true = leftVal.iVal > rightVal.iVal;
-                break;
-            case GE:
-                _true = leftVal.iVal >= rightVal.iVal;
-                break;
-            case LT:
-                _true = leftVal.iVal < rightVal.iVal;
-                break;
-            case LE:
-                _true = leftVal.iVal <= rightVal.iVal;
-                break;
-        }
-        return ExpVal(int(_true));
+    NodeId Arena::insert(const Fragment &fragment) {
+        auto mark = this->mark();
+        nodes.insert(nodes.end(), fragment.nodes.begin(), fragment.nodes.end());
+        strings.insert(strings.end(), fragment.strings.begin(), fragment.strings.end());
+        for (auto it = nodes.begin() + mark.first; it != nodes.end(); ++it) {
+            if (it->left != NO_NODE)
+                it->left += mark.first;
+            if (it->right != NO_NODE)
+                it->right += mark.first;
+            if (hasString(*it))
+                it->str += mark.second;
+        }
+        return fragment.root + mark.first;
     }
 
-    void IfThenExp::checkValidation(MainWindow *mainWindow) {
-        test->checkValidation(mainWindow);
-        if (lineno->getValue() <= 0 || lineno->getValue() > 100000)
-            throw "Invalid line number!";
+    std::vector <OutlineRow> SyntaxTree::outline() const {
+        std::vector <OutlineRow> rows;
+        Printer(*arena, rows).print(root, 0);
+        return rows;
     }
 
-    void IfThenExp::print(std::string &str, int depth) {
-        indent(str, depth);
-        str += "IF THEN\n";
-        test->print(str, depth + 1);
+    void SyntaxTree::print(std::string &str) const {
+        bool first = true;
+        for (const auto &row: outline()) {
+            if (!first)
+                str += '\n';
+            first = false;
+            indent(str, row.depth);
+            str += row.label;
+        }
         str += '\n';
-        lineno->print(str, depth + 1);
     }
 
-    ExpVal IfThenExp::run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-        ExpVal testVal = test->run(mainWindow, resultDisplay);
-        ExpVal linenoVal = lineno->run(mainWindow, resultDisplay);
-        if (testVal.iVal == 1) {
-            mainWindow->gotoLine(linenoVal.iVal);
-        }
+    void SyntaxTree::run(Interpreter *interpreter) const {
+        Evaluator(*arena, interpreter).visit(root);
+    }
+
+    void SyntaxTree::checkValidation(Interpreter *interpreter) const {
+        (void) interpreter;
+        Validator(*arena).visit(root);
+    }
 
-        return ExpVal::voidValue();
+    void SyntaxTree::resolve(Interpreter *interpreter) {
+        Resolver(*arena, interpreter).visit(root);
     }
 
-    ExpVal ExpVal::_voidVal(true);
+    void SyntaxTree::link(Interpreter *interpreter) {
+        Linker(*arena, interpreter).visit(root);
+    }
 
-    SyntaxTree::SyntaxTree(Exp *root) : root(root) {}
+    void SyntaxTree::compile(bytecode::Compiler *compiler) const {
+        Emitter(*arena, compiler).visit(root);
+    }
 
-    SyntaxTree::~SyntaxTree() { clear(); }
+    void SyntaxTree::fold(optimizer::Folder *folder) {
+        root = folder->foldTree(root);
+    }
 }
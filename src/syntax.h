@@ -1,21 +1,28 @@
 #ifndef QBASIC_SYNTAX_H
 #define QBASIC_SYNTAX_H
 
+#include <climits>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <string>
-#include "mainwindow.h"
-#include <QTextBrowser>
+#include <utility>
+#include <vector>
+#include "interpreter.h"
+#include "bytecode.h"
+
+namespace optimizer {
+    class Folder;
+}
 
 namespace syntax {
+    using Interpreter = interpreter::Interpreter;
+
     inline void indent(std::string &str, int depth) {
         for (int i = 0; i < depth; ++i)
             str += "  ";
     }
 
-    class ExpVal;
-
-    class Exp;
-
     enum valueType {
         INT,
         STRING,
@@ -39,396 +46,339 @@ namespace syntax {
         LE
     };
 
+    // Shared by the evaluator and the constant folder, so that both fail the same way.
+    inline int applyArithmetic(ArithmeticOp op, int left, int right) {
+        switch (op) {
+            case PLUS_OP:
+                return left + right;
+            case MINUS_OP:
+                return left - right;
+            case TIMES_OP:
+                return left * right;
+            case DIVIDE_OP:
+                if (right == 0) throw "Divided by zero!";
+                return left / right;
+            case INDEX_OP:
+                // 0 ** 0, 0 ** -1 is no valid, but 0 ** 1 is valid.
+                if (left == 0 && right <= 0) throw "Invalid index operation!";
+                return int(pow(left, right));
+        }
+        throw "Non-existent operation type!";
+    }
+
+    // applyArithmetic gives a plain value or its own error. An overflow, INT_MIN / -1 or a power out of range is
+    // left to the run, the folders must not evaluate it.
+    inline bool isPlainArithmetic(ArithmeticOp op, int left, int right) {
+        long long wide;
+        switch (op) {
+            case PLUS_OP:
+                wide = (long long) left + right;
+                break;
+            case MINUS_OP:
+                wide = (long long) left - right;
+                break;
+            case TIMES_OP:
+                wide = (long long) left * right;
+                break;
+            case DIVIDE_OP:
+                return !(left == INT_MIN && right == -1);
+            case INDEX_OP: {
+                if (left == 0 && right <= 0) return true;
+                double power = pow(left, right);
+                return power >= INT_MIN && power <= INT_MAX;
+            }
+            default:
+                return true;
+        }
+        return wide >= INT_MIN && wide <= INT_MAX;
+    }
+
+    inline int applyLogical(LogicOp op, int left, int right) {
+        switch (op) {
+            case EQ:
+                return left == right;
+            case NEQ:
+                return left != right;
+            case GT:
+                return left > right;
+            case GE:
+                return left >= right;
+            case LT:
+                return left < right;
+            case LE:
+                return left <= right;
+        }
+        return 0;
+    }
+
+    // Tagged value of an exp, the string lives out of line in the syntax tree or in a variable,
+    // so it is only valid until the variable is assigned again.
     class ExpVal {
     public:
         ExpVal() = default;
 
-        ExpVal(int iVal) : iVal(iVal), type(INT) {}
+        ExpVal(int iVal) : type(INT), iVal(iVal) {}
 
-        ExpVal(const std::string &sVal) : sVal(sVal), type(STRING) {}
+        ExpVal(const std::string *sVal) : type(STRING), sVal(sVal) {}
 
-        static inline ExpVal voidValue() { return _voidVal; }
+        static inline ExpVal voidValue() { return ExpVal(VOID); }
 
-        int iVal;
-        std::string sVal;
         valueType type;
+        union {
+            int iVal;
+            const std::string *sVal;
+        };
     private:
-        ExpVal(bool isVoid) { if (isVoid) type = VOID; }
-
-        static ExpVal _voidVal;
+        ExpVal(valueType type) : type(type), sVal(nullptr) {}
     };
 
-    class Exp {
-    public:
-        virtual void print(std::string &str, int depth) = 0;
-
-        virtual ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) = 0;
-
-        virtual void clear() = 0;
-
-        virtual void checkValidation(MainWindow *mainWindow) { Q_UNUSED(mainWindow); }
-
-        virtual ~Exp() = default;
+    static_assert(sizeof(ExpVal) <= 16, "ExpVal should fit in two registers");
+
+    // Index of a node in its arena.
+    using NodeId = uint32_t;
+
+    const NodeId NO_NODE = UINT32_MAX;
+
+    enum NodeKind : unsigned char {
+        STRING_EXP,
+        INT_EXP,
+        REM_EXP,        // left: STRING_EXP content
+        VAR_EXP,
+        PRINT_EXP,      // left: exp
+        INPUT_EXP,      // left: VAR_EXP
+        GOTO_EXP,       // left: INT_EXP line number
+        END_EXP,
+        ARITHMETIC_EXP, // left op right
+        LET_EXP,        // left: VAR_EXP, right: value
+        LOGICAL_EXP,    // left op right
+        IF_THEN_EXP,    // left: LOGICAL_EXP test, right: INT_EXP line number
+        // Fused forms of common statements, made by the optimizer only.
+        INC_EXP,        // LET x = x + c, left: VAR_EXP, right: INT_EXP c
+        BRANCH_EXP,     // IF x op c THEN n, same as IF_THEN_EXP, the test is VAR_EXP op INT_EXP
     };
 
-    class StringExp : public Exp {
-    private:
-        std::string val;
-
-    public:
-        StringExp(const std::string &val) : val(val) {}
-
-        inline void clear() override {
-            return;
-        }
-
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += this->val;
-        };
-
-        inline ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override {
-            Q_UNUSED(mainWindow);
-            Q_UNUSED(resultDisplay);
-            return ExpVal(this->val);
-        }
+    struct Node {
+        NodeKind kind;
+        // ArithmeticOp of ARITHMETIC_EXP, LogicOp of LOGICAL_EXP,
+        // LET_EXP and INC_EXP: 1 if fused with the GOTO following it, to the statement of index value.
+        unsigned char op;
+        // VAR_EXP, ARITHMETIC_EXP and LOGICAL_EXP: proven to be an int, so evaluated without type checks,
+        // INC_EXP and BRANCH_EXP: the variable is.
+        bool intOnly;
+        NodeId left;
+        NodeId right;
+        // INT_EXP: the value, VAR_EXP: the slot, GOTO_EXP, IF_THEN_EXP and BRANCH_EXP: index of the target
+        // statement, also of LET_EXP and INC_EXP fused with a GOTO.
+        int value;
+        // STRING_EXP and VAR_EXP: index of the string in the arena.
+        uint32_t str;
+
+        // The exp evaluates to an int, or fails with anything but a type error.
+        inline bool isInt() const { return kind == INT_EXP || intOnly; }
     };
 
-    class IntExp : public Exp {
-    private:
-        int val;
+    // Nodes and strings of one syntax tree kept out of any arena, with ids relative to its first node and string.
+    struct Fragment {
+        std::vector <Node> nodes;
+        std::vector <std::string> strings;
+        NodeId root = NO_NODE;
+    };
 
+    // Nodes of all the statements of a program, in one contiguous array addressed by index.
+    // Nodes are plain data, so dropping them all is O(1) and the storage is reused by the next parse.
+    class Arena {
     public:
-        IntExp(int val) : val(val) {}
-
-        inline void clear() override {
-            return;
-        }
+        Arena() = default;
 
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += std::to_string(val);
-        };
+        inline const Node &operator[](NodeId id) const { return nodes[id]; }
 
-        inline ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override {
-            Q_UNUSED(mainWindow);
-            Q_UNUSED(resultDisplay);
-            return ExpVal(this->val);
-        }
+        inline Node &operator[](NodeId id) { return nodes[id]; }
 
-        inline int getValue() const { return val; }
-    };
+        inline const std::string &string(const Node &node) const { return strings[node.str]; }
 
-    class RemExp : public Exp {
-    private:
-        StringExp *content;
+        inline size_t size() const { return nodes.size(); }
 
-    public:
-        RemExp(StringExp *content) : content(content) {}
-
-        inline void clear() override {
-            content->clear();
-            delete content;
+        inline void clear() {
+            nodes.clear();
+            strings.clear();
         }
 
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += "REM\n";
-            content->print(str, depth + 1);
-        }
+        // Where the next node and string go, the nodes added from there on can be extracted as a fragment.
+        inline std::pair<NodeId, uint32_t> mark() const { return {NodeId(nodes.size()), uint32_t(strings.size())}; }
 
-        inline ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override {
-            Q_UNUSED(mainWindow);
-            Q_UNUSED(resultDisplay);
-            return ExpVal::voidValue();
-        }
-    };
+        // Copy of the tree at root, all of its nodes were added since the mark.
+        Fragment extract(std::pair<NodeId, uint32_t> mark, NodeId root) const;
 
-    class VarExp : public Exp {
-    private:
-        std::string symbol;
+        // Add a copy of the fragment, return its root.
+        NodeId insert(const Fragment &fragment);
 
-    public:
-        VarExp(const std::string &symbol) : symbol(symbol) {}
+        inline NodeId stringExp(const std::string &val) { return add(STRING_EXP, 0, NO_NODE, NO_NODE, 0, val); }
 
-        inline void clear() override {}
+        inline NodeId intExp(int val) { return add(INT_EXP, 0, NO_NODE, NO_NODE, val); }
 
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += this->symbol;
-        }
+        inline NodeId remExp(NodeId content) { return add(REM_EXP, 0, content, NO_NODE); }
 
-        void checkValidation(MainWindow *mainWindow) override {
-            Q_UNUSED(mainWindow);
-            // just do nothing, since in this stage the variable won't have been defined.
-//            if (mainWindow->tenv->look(symbol) == nullptr)
-//                throw "Undefined variable!";
-        }
+        inline NodeId varExp(const std::string &symbol) { return add(VAR_EXP, 0, NO_NODE, NO_NODE, -1, symbol); }
 
-        inline ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override {
-            Q_UNUSED(resultDisplay);
-            env::ValueType *valueTypePtr = mainWindow->tenv->look(symbol);
-            if (valueTypePtr != nullptr) {
-                env::ValueType valueType = *valueTypePtr;
-                env::Value *value = mainWindow->venv->look(symbol);
-                if (valueType == env::INT)
-                    return ExpVal(value->getInt());
-                else
-                    return ExpVal(value->getString());
-            }
-            throw "Use undefined variable!";
-        }
+        inline NodeId printExp(NodeId exp) { return add(PRINT_EXP, 0, exp, NO_NODE); }
 
-        inline std::string getSymbol() const { return symbol; }
-    };
+        inline NodeId inputExp(NodeId var) { return add(INPUT_EXP, 0, var, NO_NODE); }
 
-    class PrintExp : public Exp {
-    private:
-        Exp *exp;
+        inline NodeId gotoExp(NodeId lineno) { return add(GOTO_EXP, 0, lineno, NO_NODE, -1); }
 
-    public:
-        PrintExp(Exp *exp) : exp(exp) {}
+        inline NodeId endExp() { return add(END_EXP, 0, NO_NODE, NO_NODE); }
 
-        inline void clear() override {
-            exp->clear();
-            delete exp;
+        inline NodeId arithmeticExp(ArithmeticOp op, NodeId left, NodeId right) {
+            return add(ARITHMETIC_EXP, op, left, right);
         }
 
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += "PRINT\n";
-            exp->print(str, depth + 1);
-        }
+        inline NodeId letExp(NodeId var, NodeId val) { return add(LET_EXP, 0, var, val); }
 
-        void checkValidation(MainWindow *mainWindow) override;
+        inline NodeId logicalExp(LogicOp op, NodeId left, NodeId right) { return add(LOGICAL_EXP, op, left, right); }
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
-    };
+        inline NodeId ifThenExp(NodeId test, NodeId lineno) { return add(IF_THEN_EXP, 0, test, lineno, -1); }
 
-    class InputExp : public Exp {
     private:
-        VarExp *var;
-    public:
-        InputExp(VarExp *var) : var(var) {}
+        std::vector <Node> nodes;
 
-        inline void clear() override {
-            var->clear();
-            delete var;
-        }
+        std::vector <std::string> strings;
 
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += "INPUT\n";
-            var->print(str, depth + 1);
+        inline NodeId add(NodeKind kind, unsigned char op, NodeId left, NodeId right, int value = 0) {
+            nodes.push_back(Node{kind, op, false, left, right, value, 0});
+            return nodes.size() - 1;
         }
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
-    };
-
-    class GotoExp : public Exp {
-    private:
-        IntExp *lineno;
-    public:
-        GotoExp(IntExp *lineno) : lineno(lineno) {}
-
-        inline void clear() override {
-            lineno->clear();
-            delete lineno;
-        }
-
-        inline void checkValidation(MainWindow *mainWindow) override {
-            Q_UNUSED(mainWindow);
-            if (lineno->getValue() <= 0 || lineno->getValue() > 1000000)
-                throw "Invalid line number!";
+        inline NodeId add(NodeKind kind, unsigned char op, NodeId left, NodeId right, int value,
+                          const std::string &str) {
+            strings.push_back(str);
+            nodes.push_back(Node{kind, op, false, left, right, value, uint32_t(strings.size() - 1)});
+            return nodes.size() - 1;
         }
-
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += "GOTO\n";
-            lineno->print(str, depth + 1);
-        }
-
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
     };
 
-    class EndExp : public Exp {
+    // Visit the nodes of an arena, Derived provides visitXxx for the kinds it cares about,
+    // and the others just visit their children. R is what a visit returns.
+    template<typename Derived, typename R = void>
+    class Visitor {
     public:
-        EndExp() = default;
-
-        inline void clear() override {}
-
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += "END";
+        Visitor(Arena &arena) : arena(arena) {}
+
+        R visit(NodeId id) {
+            Node &node = arena[id];
+            switch (node.kind) {
+                case STRING_EXP:
+                    return self().visitString(node);
+                case INT_EXP:
+                    return self().visitInt(node);
+                case REM_EXP:
+                    return self().visitRem(node);
+                case VAR_EXP:
+                    return self().visitVar(node);
+                case PRINT_EXP:
+                    return self().visitPrint(node);
+                case INPUT_EXP:
+                    return self().visitInput(node);
+                case GOTO_EXP:
+                    return self().visitGoto(node);
+                case END_EXP:
+                    return self().visitEnd(node);
+                case ARITHMETIC_EXP:
+                    return self().visitArithmetic(node);
+                case LET_EXP:
+                    return self().visitLet(node);
+                case LOGICAL_EXP:
+                    return self().visitLogical(node);
+                case IF_THEN_EXP:
+                    return self().visitIfThen(node);
+                case INC_EXP:
+                    return self().visitInc(node);
+                case BRANCH_EXP:
+                    return self().visitBranch(node);
+            }
+            throw "Non-existent node kind!";
         }
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
-    };
+    protected:
+        Arena &arena;
 
-    class ArithmeticExp : public Exp {
-    private:
-        ArithmeticOp op;
-        Exp *left, *right;
-
-        ArithmeticExp(ArithmeticOp op, Exp *left, Exp *right) : op(op), left(left), right(right) {}
-
-    public:
-        static inline ArithmeticExp *plusExp(Exp *left, Exp *right) {
-            return new ArithmeticExp(PLUS_OP, left, right);
+        R visitChildren(Node &node) {
+            if (node.left != NO_NODE)
+                visit(node.left);
+            if (node.right != NO_NODE)
+                visit(node.right);
+            return R();
         }
 
-        static inline ArithmeticExp *minusExp(Exp *left, Exp *right) {
-            return new ArithmeticExp(MINUS_OP, left, right);
-        }
+        R visitString(Node &node) { return self().visitChildren(node); }
 
-        static inline ArithmeticExp *timesExp(Exp *left, Exp *right) {
-            return new ArithmeticExp(TIMES_OP, left, right);
-        }
+        R visitInt(Node &node) { return self().visitChildren(node); }
 
-        static inline ArithmeticExp *divideExp(Exp *left, Exp *right) {
-            return new ArithmeticExp(DIVIDE_OP, left, right);
-        }
+        R visitRem(Node &node) { return self().visitChildren(node); }
 
-        static inline ArithmeticExp *indexExp(Exp *left, Exp *right) {
-            return new ArithmeticExp(INDEX_OP, left, right);
-        }
+        R visitVar(Node &node) { return self().visitChildren(node); }
 
-        inline void clear() override {
-            left->clear();
-            right->clear();
-            delete left;
-            delete right;
-        }
+        R visitPrint(Node &node) { return self().visitChildren(node); }
 
-        void checkValidation(MainWindow *mainWindow) override;
+        R visitInput(Node &node) { return self().visitChildren(node); }
 
-        void print(std::string &str, int depth) override;
+        R visitGoto(Node &node) { return self().visitChildren(node); }
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
-    };
+        R visitEnd(Node &node) { return self().visitChildren(node); }
 
-    class LetExp : public Exp {
-    private:
-        VarExp *var;
-        Exp *val;
+        R visitArithmetic(Node &node) { return self().visitChildren(node); }
 
-    public:
-        LetExp(VarExp *var, Exp *val) : var(var), val(val) {}
+        R visitLet(Node &node) { return self().visitChildren(node); }
 
-        inline void clear() override {
-            var->clear();
-            val->clear();
-            delete var;
-            delete val;
-        }
+        R visitLogical(Node &node) { return self().visitChildren(node); }
 
-        void checkValidation(MainWindow *mainWindow) override;
+        R visitIfThen(Node &node) { return self().visitChildren(node); }
 
-        inline void print(std::string &str, int depth) override {
-            indent(str, depth);
-            str += "LET =\n";
-            var->print(str, depth + 1);
-            str += '\n';
-            val->print(str, depth + 1);
-        }
+        R visitInc(Node &node) { return self().visitChildren(node); }
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
-    };
+        R visitBranch(Node &node) { return self().visitChildren(node); }
 
-    class LogicalExp : public Exp {
     private:
-        LogicOp op;
-        Exp *left, *right;
-    public:
-        LogicalExp(LogicOp op, Exp *left, Exp *right) : op(op), left(left), right(right) {}
-
-        static inline LogicalExp *eqExp(Exp *left, Exp *right) {
-            return new LogicalExp(EQ, left, right);
-        }
-
-        static inline LogicalExp *neqExp(Exp *left, Exp *right) {
-            return new LogicalExp(NEQ, left, right);
-        }
-
-        static inline LogicalExp *gtExp(Exp *left, Exp *right) {
-            return new LogicalExp(GT, left, right);
-        }
-
-        static inline LogicalExp *geExp(Exp *left, Exp *right) {
-            return new LogicalExp(GE, left, right);
-        }
-
-        static inline LogicalExp *ltExp(Exp *left, Exp *right) {
-            return new LogicalExp(LT, left, right);
-        }
-
-        static inline LogicalExp *leExp(Exp *left, Exp *right) {
-            return new LogicalExp(LE, left, right);
-        }
-
-        inline void clear() override {
-            left->clear();
-            right->clear();
-            delete left;
-            delete right;
-        }
-
-        void checkValidation(MainWindow *mainWindow) override;
-
-        void print(std::string &str, int depth) override;
+        inline Derived &self() { return *static_cast<Derived *>(this); }
+    };
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
+    // A line of a printed syntax tree, the children of a node are a level deeper.
+    struct OutlineRow {
+        int depth;
+        std::string label;
     };
 
-    class IfThenExp : public Exp {
-    private:
-        LogicalExp *test;
-        IntExp *lineno;
+    // Handle of the syntax tree of a statement, the nodes live in the arena.
+    class SyntaxTree {
     public:
-        IfThenExp(LogicalExp *test, IntExp *lineno) : test(test), lineno(lineno) {}
-
-        inline void clear() override {
-            test->clear();
-            lineno->clear();
-            delete test;
-            delete lineno;
-        }
+        SyntaxTree() = delete;
 
-        void checkValidation(MainWindow *mainWindow) override;
+        SyntaxTree(Arena *arena, NodeId root) : arena(arena), root(root) {}
 
-        void print(std::string &str, int depth) override;
+        void print(std::string &str) const;
 
-        ExpVal run(MainWindow *mainWindow, QTextBrowser *resultDisplay) override;
-    };
+        // The lines print writes, the root first at depth 0.
+        std::vector <OutlineRow> outline() const;
 
-    class SyntaxTree {
-    public:
-        SyntaxTree() = delete;
+        void run(Interpreter *interpreter) const;
 
-        ~SyntaxTree();
+        void checkValidation(Interpreter *interpreter) const;
 
-        SyntaxTree(Exp *root);
+        // Resolve the variables to their slots in the interpreter.
+        void resolve(Interpreter *interpreter);
 
-        inline void print(std::string &str) {
-            root->print(str, 0);
-            str += '\n';
-        }
+        // Resolve the jump targets to statement indices, once the whole program is parsed.
+        void link(Interpreter *interpreter);
 
-        inline void run(MainWindow *mainWindow, QTextBrowser *resultDisplay) {
-            root->run(mainWindow, resultDisplay);
-        }
+        // Emit the bytecode of the statement.
+        void compile(bytecode::Compiler *compiler) const;
 
-        inline void clear() {
-            root->clear();
-            delete root;
-        }
+        void fold(optimizer::Folder *folder);
 
-        inline void checkValidation(MainWindow *mainwindow) {
-            root->checkValidation(mainwindow);
-        }
+        inline NodeId getRoot() const { return root; }
 
     private:
-        Exp *root;
+        Arena *arena;
+        NodeId root;
     };
 }
 
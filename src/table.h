@@ -1,7 +1,10 @@
 #ifndef TABLE_H
 #define TABLE_H
 
-#include <map>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace env {
     enum ValueType {
@@ -24,30 +27,116 @@ namespace env {
 
         inline int getInt() const { return iVal; }
 
-        inline std::string getString() const { return sVal; }
+        inline const std::string &getString() const { return sVal; }
     };
 
-    template<typename K, typename V>
+    // Type and value of a variable, kept in the slot resolved for its symbol.
+    class Variable {
+    public:
+        bool defined = false;
+        ValueType type = INT;
+        Value value;
+
+        inline void set(int iVal) {
+            defined = true;
+            type = INT;
+            value = Value(iVal);
+        }
+
+        inline void set(const std::string &sVal) {
+            defined = true;
+            type = STRING;
+            value = Value(sVal);
+        }
+    };
+
+    // Hash of the table keys, std::string keys can be looked up by std::string_view without a copy.
+    template<typename K>
+    struct Hash : std::hash<K> {
+    };
+
+    template<>
+    struct Hash<std::string> {
+        inline size_t operator()(std::string_view key) const {
+            return std::hash<std::string_view>()(key);
+        }
+    };
+
+    // Open addressing with linear probing, entries live in one flat array.
+    template<typename K, typename V, typename H = Hash<K>>
     class Table {
     private:
-        std::map <K, V> map;
+        struct Entry {
+            // 0 marks an empty entry, see hashOf.
+            size_t hash = 0;
+            K key;
+            V value;
+        };
+
+        std::vector <Entry> entries;
+
+        size_t count = 0;
+
+        template<typename Q>
+        static inline size_t hashOf(const Q &key) {
+            size_t hash = H()(key);
+            return hash == 0 ? 1 : hash;
+        }
+
+        // The entry of key, or the empty entry it would take.
+        template<typename Q>
+        inline Entry &probe(const Q &key, size_t hash) {
+            size_t mask = entries.size() - 1;
+            for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                Entry &entry = entries[i];
+                if (entry.hash == 0 || (entry.hash == hash && entry.key == key))
+                    return entry;
+            }
+        }
+
+        void grow() {
+            std::vector <Entry> old(entries.empty() ? 16 : entries.size() * 2);
+            old.swap(entries);
+            for (auto &entry: old) {
+                if (entry.hash != 0)
+                    probe(entry.key, entry.hash) = std::move(entry);
+            }
+        }
+
     public:
         Table() = default;
 
         ~Table() = default;
 
-        inline V *look(const K &key) {
-            if (map.find(key) != map.end())
-                return &(map[key]);
-            return nullptr;
+        template<typename Q>
+        inline V *look(const Q &key) {
+            if (count == 0)
+                return nullptr;
+            Entry &entry = probe(key, hashOf(key));
+            return entry.hash != 0 ? &entry.value : nullptr;
         }
 
         inline void enter(const K &key, const V &value) {
-            map[key] = value;
+            // Keep the load factor under 3/4.
+            if ((count + 1) * 4 > entries.size() * 3)
+                grow();
+            size_t hash = hashOf(key);
+            Entry &entry = probe(key, hash);
+            if (entry.hash == 0) {
+                entry.hash = hash;
+                entry.key = key;
+                ++count;
+            }
+            entry.value = value;
+        }
+
+        inline size_t size() const {
+            return count;
         }
 
         inline void clear() {
-            map.clear();
+            entries.clear();
+            count = 0;
         }
     };
 }
@@ -0,0 +1,360 @@
+#include "transpiler.h"
+#include <cctype>
+#include "statement.h"
+
+namespace transpiler {
+    using namespace syntax;
+
+    // Runtime of the generated code, the same for every program.
+    static const char *const prelude = R"(// Generated by qbasic-cli --emit-cpp, build with: g++ -O2 -o program program.cpp
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+enum ValueType : unsigned char {
+    UNDEFINED,
+    INT,
+    STRING,
+};
+
+// Ints wrap around as in the interpreter, instead of overflowing.
+static inline int add(int left, int right) { return int(unsigned(left) + unsigned(right)); }
+
+static inline int sub(int left, int right) { return int(unsigned(left) - unsigned(right)); }
+
+static inline int mul(int left, int right) { return int(unsigned(left) * unsigned(right)); }
+
+static inline int power(int left, int right) { return int(std::pow(left, right)); }
+
+static inline void print(int value) { std::printf("%d\n", value); }
+
+static inline void print(const std::string &str) {
+    std::fwrite(str.data(), 1, str.size(), stdout);
+    std::putchar('\n');
+}
+
+// stdout is flushed before anything goes to stderr, as std::cerr does with std::cout.
+static inline void error(int lineno, const char *errorMsg) {
+    std::fflush(stdout);
+    std::fprintf(stderr, "Line %d: %s\n", lineno, errorMsg);
+}
+
+// Feed a variable as the command line does: an int, a "string", or anything else that leaves it unchanged.
+// false at the end of the input.
+static inline bool input(int &value, ValueType &type, std::string &str) {
+    std::fflush(stdout);
+    std::fputs("? ", stderr);
+    std::string line;
+    if (!std::getline(std::cin, line))
+        return false;
+    size_t first = line.find_first_not_of(' ');
+    first = first != std::string::npos ? first : 0;
+    size_t last = line.find_last_not_of(' ');
+    last = last != std::string::npos ? last : line.size() - 1;
+    line = line.substr(first, last - first + 1);
+
+    if (line == "0" || (!line.empty() && line[0] >= '1' && line[0] <= '9'
+                        && line.find_first_not_of("0123456789") == std::string::npos)) {
+        value = std::atoi(line.c_str());
+        type = INT;
+    } else if (line.size() >= 2 && line.front() == '"' && line.back() == '"'
+               && line.find_first_of("\r\n") == std::string::npos) {
+        str = line.substr(1, line.size() - 2);
+        type = STRING;
+    }
+    return true;
+}
+
+int main() {
+)";
+
+    // Operators of the generated code, indexed by LogicOp.
+    static const char *const comparisons[] = {" == ", " != ", " > ", " >= ", " < ", " <= "};
+
+    static std::string quote(const std::string &str) {
+        static const char digits[] = "01234567";
+        std::string result = "\"";
+        for (unsigned char ch: str) {
+            if (ch == '"' || ch == '\\') {
+                result += '\\';
+                result += char(ch);
+            } else if (ch < 0x20 || ch >= 0x7f) {
+                // Always 3 digits, so that the next character can't extend the escape.
+                result += '\\';
+                result += digits[ch >> 6];
+                result += digits[(ch >> 3) & 7];
+                result += digits[ch & 7];
+            } else {
+                result += char(ch);
+            }
+        }
+        return result + '"';
+    }
+
+    // The source of a statement as a line comment, which a trailing backslash would continue.
+    static std::string comment(const std::string &src) {
+        std::string result;
+        for (char ch: src)
+            result += ch == '\n' || ch == '\r' ? ' ' : ch;
+        while (!result.empty() && (result.back() == '\\' || result.back() == ' '))
+            result.pop_back();
+        return result;
+    }
+
+    std::string Transpiler::translate(const Arena &arena, const std::vector<statement::Statement *> &statements,
+                                      const std::vector <std::string> &symbols) {
+        this->arena = &arena;
+        int len = statements.size();
+        labels.assign(len + 1, false);
+
+        names.clear();
+        int slotCount = symbols.size();
+        for (int slot = 0; slot < slotCount; ++slot) {
+            // Symbols are made of letters and digits, the slot keeps the names apart from the temporaries.
+            bool plain = true;
+            for (char ch: symbols[slot])
+                plain = plain && std::isalnum(static_cast<unsigned char>(ch));
+            names.push_back(plain ? std::to_string(slot) + '_' + symbols[slot] : std::to_string(slot));
+        }
+
+        std::vector <std::string> bodies(len);
+        for (current = 0; current < len; ++current) {
+            if (!statements[current])
+                continue;
+            code.clear();
+            temps = 0;
+            lineno = statements[current]->getLineno();
+            translateStatement(arena[statements[current]->getSyntaxTree()->getRoot()]);
+            bodies[current] = "    // " + comment(statements[current]->toString()) + '\n';
+            if (temps == 0) {
+                bodies[current] += code;
+                continue;
+            }
+            // Scope the temporaries to the statement, so that no goto skips their initialization.
+            bodies[current] += "    {\n";
+            for (size_t begin = 0; begin < code.size();) {
+                size_t end = code.find('\n', begin) + 1;
+                bodies[current] += "    " + code.substr(begin, end - begin);
+                begin = end;
+            }
+            bodies[current] += "    }\n";
+        }
+
+        std::string result = prelude;
+        for (int slot = 0; slot < slotCount; ++slot) {
+            result += "    [[maybe_unused]] int " + name(slot, 'v') + " = 0;\n";
+            result += "    [[maybe_unused]] ValueType " + name(slot, 't') + " = UNDEFINED;\n";
+            result += "    [[maybe_unused]] std::string " + name(slot, 's') + ";\n";
+        }
+        for (int i = 0; i < len; ++i) {
+            if (labels[i])
+                result += "s" + std::to_string(i) + ":\n";
+            result += bodies[i];
+        }
+        if (labels[len])
+            result += "s" + std::to_string(len) + ":\n";
+        result += "    return 0;\n}\n";
+        return result;
+    }
+
+    void Transpiler::translateStatement(const Node &node) {
+        const Arena &arena = *this->arena;
+        switch (node.kind) {
+            case LET_EXP: {
+                int slot = arena[node.left].value;
+                const Node &value = arena[node.right];
+                // Same as Validator::isAssignable.
+                bool assignable = value.kind == STRING_EXP || value.kind == INT_EXP || value.kind == ARITHMETIC_EXP;
+                if (!value.isInt() && !assignable) {
+                    fail("", "Invalid assignment value!");
+                    break;
+                }
+                Operand operand = translateExp(node.right);
+                if (operand.type == "STRING") {
+                    line(name(slot, 's') + " = " + operand.str + ';');
+                    line(name(slot, 't') + " = STRING;");
+                } else {
+                    line(name(slot, 'v') + " = " + operand.value + ';');
+                    line(name(slot, 't') + " = INT;");
+                }
+                if (node.op)
+                    line(jumpTo(node.value));
+                break;
+            }
+            case INC_EXP: {
+                int slot = arena[node.left].value;
+                if (!node.intOnly) {
+                    fail(name(slot, 't') + " == UNDEFINED", "Use undefined variable!");
+                    fail(name(slot, 't') + " != INT", "Arithmetic operation only supports int!");
+                }
+                line(name(slot, 'v') + " = add(" + name(slot, 'v') + ", " + std::to_string(arena[node.right].value)
+                     + ");");
+                if (node.op)
+                    line(jumpTo(node.value));
+                break;
+            }
+            case PRINT_EXP: {
+                Operand operand = translateExp(node.left);
+                if (operand.type == "INT")
+                    line("print(" + operand.value + ");");
+                else if (operand.type == "STRING")
+                    line("print(" + operand.str + ");");
+                else
+                    line("if (" + operand.type + " == INT) print(" + operand.value + "); else print(" + operand.str
+                         + ");");
+                break;
+            }
+            case INPUT_EXP: {
+                int slot = arena[node.left].value;
+                line("if (!input(" + name(slot, 'v') + ", " + name(slot, 't') + ", " + name(slot, 's') + ")) "
+                     + jumpTo(labels.size() - 1));
+                break;
+            }
+            case GOTO_EXP:
+                if (node.value < 0)
+                    fail("", "Use non-existent line number!");
+                else
+                    line(jumpTo(node.value));
+                break;
+            case END_EXP:
+                line(jumpTo(labels.size() - 1));
+                break;
+            case IF_THEN_EXP: {
+                Operand test = translateExp(node.left);
+                if (node.value < 0)
+                    fail(test.value + " == 1", "Use non-existent line number!");
+                else
+                    line("if (" + test.value + " == 1) " + jumpTo(node.value));
+                break;
+            }
+            case BRANCH_EXP: {
+                const Node &test = arena[node.left];
+                int slot = arena[test.left].value;
+                if (!node.intOnly) {
+                    fail(name(slot, 't') + " == UNDEFINED", "Use undefined variable!");
+                    fail(name(slot, 't') + " != INT", "Logical operation only supports int!");
+                }
+                std::string condition = name(slot, 'v') + comparisons[test.op] + std::to_string(arena[test.right].value);
+                if (node.value < 0)
+                    fail(condition, "Use non-existent line number!");
+                else
+                    line("if (" + condition + ") " + jumpTo(node.value));
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    Transpiler::Operand Transpiler::translateExp(NodeId exp) {
+        const Node &node = (*arena)[exp];
+        switch (node.kind) {
+            case STRING_EXP:
+                return Operand{"0", "STRING", quote(arena->string(node))};
+            case INT_EXP:
+                return Operand{std::to_string(node.value), "INT", ""};
+            case VAR_EXP:
+                if (node.intOnly)
+                    return Operand{name(node.value, 'v'), "INT", ""};
+                fail(name(node.value, 't') + " == UNDEFINED", "Use undefined variable!");
+                return Operand{name(node.value, 'v'), name(node.value, 't'), name(node.value, 's')};
+            case ARITHMETIC_EXP:
+            case LOGICAL_EXP:
+                return translateBinary(node);
+            default:
+                return Operand{"0", "UNDEFINED", ""};
+        }
+    }
+
+    Transpiler::Operand Transpiler::translateBinary(const Node &node) {
+        Operand left = translateExp(node.left);
+        Operand right = translateExp(node.right);
+
+        if (!node.intOnly) {
+            const char *errorMsg = node.kind == ARITHMETIC_EXP ? "Arithmetic operation only supports int!"
+                                                               : "Logical operation only supports int!";
+            std::string condition;
+            for (const Operand *operand: {&left, &right}) {
+                if (operand->type == "INT")
+                    continue;
+                if (!condition.empty())
+                    condition += " || ";
+                condition += operand->type + " != INT";
+            }
+            if (!condition.empty())
+                fail(condition, errorMsg);
+        }
+
+        std::string value;
+        if (node.kind == LOGICAL_EXP) {
+            value = "int(" + left.value + comparisons[node.op] + right.value + ")";
+        } else {
+            switch (node.op) {
+                case PLUS_OP:
+                    value = "add(" + left.value + ", " + right.value + ")";
+                    break;
+                case MINUS_OP:
+                    value = "sub(" + left.value + ", " + right.value + ")";
+                    break;
+                case TIMES_OP:
+                    value = "mul(" + left.value + ", " + right.value + ")";
+                    break;
+                case DIVIDE_OP:
+                    if (isConstant(node.right, [](int value) { return value == 0; })) {
+                        // Leave no constant division by zero to the compiler.
+                        fail("", "Divided by zero!");
+                        value = "0";
+                        break;
+                    }
+                    if (!isConstant(node.right, [](int value) { return value != 0; }))
+                        fail(right.value + " == 0", "Divided by zero!");
+                    value = left.value + " / " + right.value;
+                    break;
+                case INDEX_OP:
+                    // 0 ** 0, 0 ** -1 is no valid, but 0 ** 1 is valid.
+                    if (!isConstant(node.left, [](int value) { return value != 0; })
+                        && !isConstant(node.right, [](int value) { return value > 0; }))
+                        fail(left.value + " == 0 && " + right.value + " <= 0", "Invalid index operation!");
+                    value = "power(" + left.value + ", " + right.value + ")";
+                    break;
+            }
+        }
+
+        std::string temp = "t" + std::to_string(temps++);
+        line("const int " + temp + " = " + value + ';');
+        return Operand{temp, "INT", ""};
+    }
+
+    template<typename Predicate>
+    bool Transpiler::isConstant(NodeId exp, Predicate predicate) const {
+        const Node &node = (*arena)[exp];
+        return node.kind == INT_EXP && predicate(node.value);
+    }
+
+    void Transpiler::line(const std::string &str) {
+        code += "    ";
+        code += str;
+        code += '\n';
+    }
+
+    void Transpiler::fail(const std::string &condition, const char *errorMsg) {
+        std::string report = "error(" + std::to_string(lineno) + ", " + quote(errorMsg) + ");";
+        // An unconditional error leaves the rest of the statement unreachable, it is emitted all the same.
+        if (condition.empty())
+            line("{ " + report + ' ' + jumpTo(current + 1) + " }");
+        else
+            line("if (" + condition + ") { " + report + ' ' + jumpTo(current + 1) + " }");
+    }
+
+    std::string Transpiler::jumpTo(int index) {
+        labels[index] = true;
+        return "goto s" + std::to_string(index) + ';';
+    }
+
+    std::string Transpiler::name(int slot, char prefix) const {
+        return std::string(1, prefix) + '_' + names[slot];
+    }
+}
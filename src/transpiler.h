@@ -0,0 +1,73 @@
+#ifndef TRANSPILER_H
+#define TRANSPILER_H
+
+#include <string>
+#include <vector>
+#include "syntax.h"
+
+namespace statement {
+    class Statement;
+}
+
+namespace transpiler {
+    // Translate a linked program to a self-contained C++ translation unit, to be built with the system compiler.
+    // Statements become labels in main, jumps become gotos and variables become locals. It runs like the command
+    // line does: PRINT to stdout, INPUT from stdin, and a runtime error is reported to stderr and skips its
+    // statement. Parse errors are reported while parsing, the binary just leaves the invalid statements out.
+    class Transpiler {
+    public:
+        Transpiler() = default;
+
+        std::string translate(const syntax::Arena &arena, const std::vector<statement::Statement *> &statements,
+                              const std::vector <std::string> &symbols);
+
+    private:
+        // C++ expressions of the value of an exp, and of its ValueType in the generated code.
+        struct Operand {
+            std::string value;
+            std::string type;
+            // Only if it may be a string.
+            std::string str;
+        };
+
+        const syntax::Arena *arena = nullptr;
+
+        // C++ name of each variable, v_ holds its int, t_ its type and s_ its string.
+        std::vector <std::string> names;
+
+        // Statements that are jumped to, and need a label, the last one is the end of the program.
+        std::vector<bool> labels;
+
+        // Code of the statement being translated.
+        std::string code;
+
+        int current = 0;
+
+        int lineno = 0;
+
+        // Temporaries of the statement being translated.
+        int temps = 0;
+
+        void translateStatement(const syntax::Node &node);
+
+        // Emit the checks of exp in the order the evaluator runs them, and return its value.
+        Operand translateExp(syntax::NodeId exp);
+
+        Operand translateBinary(const syntax::Node &node);
+
+        // The exp is an int constant the predicate holds for, so a check on it is left out.
+        template<typename Predicate>
+        bool isConstant(syntax::NodeId exp, Predicate predicate) const;
+
+        void line(const std::string &str);
+
+        // Report the error and skip the rest of the statement, under the condition if any.
+        void fail(const std::string &condition, const char *errorMsg);
+
+        std::string jumpTo(int index);
+
+        std::string name(int slot, char prefix) const;
+    };
+}
+
+#endif // TRANSPILER_H
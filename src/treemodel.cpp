@@ -0,0 +1,104 @@
+#include "treemodel.h"
+#include "statement.h"
+#include "source.h"
+
+TreeModel::TreeModel(interpreter::Interpreter *interpreter, QObject *parent)
+        : QAbstractItemModel(parent), interpreter(interpreter) {}
+
+QModelIndex TreeModel::index(int row, int column, const QModelIndex &parent) const {
+    if (!hasIndex(row, column, parent))
+        return QModelIndex();
+    if (!parent.isValid())
+        return createIndex(row, column, nullptr);
+    auto item = static_cast<const Item *>(parent.internalPointer());
+    const Line &line = this->line(item == nullptr ? parent.row() : item->line);
+    int child = item == nullptr ? line.top[row] : item->children[row];
+    return createIndex(row, column, const_cast<Item *>(&line.items[child]));
+}
+
+QModelIndex TreeModel::parent(const QModelIndex &child) const {
+    if (!child.isValid())
+        return QModelIndex();
+    auto item = static_cast<const Item *>(child.internalPointer());
+    if (item == nullptr)
+        return QModelIndex();
+    if (item->parent < 0)
+        return createIndex(item->line, 0, nullptr);
+    const Item &parent = line(item->line).items[item->parent];
+    return createIndex(parent.row, 0, const_cast<Item *>(&parent));
+}
+
+int TreeModel::rowCount(const QModelIndex &parent) const {
+    if (!attached)
+        return 0;
+    if (!parent.isValid())
+        return int(interpreter->rawStatements->size());
+    if (parent.column() > 0)
+        return 0;
+    auto item = static_cast<const Item *>(parent.internalPointer());
+    if (item == nullptr)
+        return int(line(parent.row()).top.size());
+    return int(item->children.size());
+}
+
+int TreeModel::columnCount(const QModelIndex &parent) const {
+    Q_UNUSED(parent);
+    return 1;
+}
+
+QVariant TreeModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || role != Qt::DisplayRole)
+        return QVariant();
+    auto item = static_cast<const Item *>(index.internalPointer());
+    if (item == nullptr)
+        return line(index.row()).label;
+    return item->label;
+}
+
+void TreeModel::attach() {
+    beginResetModel();
+    lines.clear();
+    attached = true;
+    endResetModel();
+}
+
+void TreeModel::detach() {
+    beginResetModel();
+    lines.clear();
+    attached = false;
+    endResetModel();
+}
+
+const TreeModel::Line &TreeModel::line(int row) const {
+    auto it = lines.find(row);
+    if (it != lines.end())
+        return it->second;
+
+    Line &line = lines[row];
+    const auto &rawStmt = interpreter->rawStatements->at(row);
+    const auto *parsed = rawStmt.parsed.get();
+    if (parsed == nullptr || parsed->type == statement::STMT_INVALID) {
+        line.label = QString::number(rawStmt.lineno).append(" Error");
+        return line;
+    }
+
+    // The cached tree is left as it is, it is printed from a copy.
+    syntax::Arena arena;
+    syntax::SyntaxTree tree(&arena, arena.insert(parsed->tree));
+    auto rows = tree.outline();
+    line.label = QString::fromStdString(std::to_string(rawStmt.lineno) + ' ' + rows[0].label);
+    line.items.reserve(rows.size() - 1);
+    // Last item at each depth, the parent of the next one a level deeper. The root is the line itself.
+    std::vector<int> last{-1};
+    for (size_t i = 1; i < rows.size(); ++i) {
+        int depth = rows[i].depth;
+        last.resize(depth);
+        int parent = last[depth - 1];
+        auto &siblings = parent < 0 ? line.top : line.items[parent].children;
+        int index = int(line.items.size());
+        line.items.push_back(Item{row, parent, int(siblings.size()), QString::fromStdString(rows[i].label), {}});
+        siblings.push_back(index);
+        last.push_back(index);
+    }
+    return line;
+}
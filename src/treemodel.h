@@ -0,0 +1,63 @@
+#ifndef TREEMODEL_H
+#define TREEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QString>
+#include <unordered_map>
+#include <vector>
+#include "interpreter.h"
+
+// Syntax trees of the program as parsed, a top-level row per line. The tree of a line is printed from its parse
+// cache only when the view first shows its row, and is kept until the program is parsed again.
+class TreeModel : public QAbstractItemModel {
+    Q_OBJECT
+
+public:
+    TreeModel(interpreter::Interpreter *interpreter, QObject *parent = nullptr);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+
+    QModelIndex parent(const QModelIndex &child) const override;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // Show the lines as parsed. Their caches must be left alone until detach.
+    void attach();
+
+    // Show nothing, e.g. while the program is parsed or edited.
+    void detach();
+
+private:
+    // A node of a printed tree, below the line.
+    struct Item {
+        int line;
+        // Index of the parent item in the line, -1 if it is the root of the tree.
+        int parent;
+        int row;
+        QString label;
+        std::vector<int> children;
+    };
+
+    struct Line {
+        QString label;
+        // Built at once, then never resized, so the items stay where the indices point.
+        std::vector<Item> items;
+        std::vector<int> top;
+    };
+
+    interpreter::Interpreter *interpreter;
+
+    bool attached = false;
+
+    // Lines printed so far by row.
+    mutable std::unordered_map<int, Line> lines;
+
+    // The line of the row, printed if it isn't yet.
+    const Line &line(int row) const;
+};
+
+#endif // TREEMODEL_H